@@ -1,8 +1,18 @@
 #include "as7265x.h"
 #include "esp_log.h"
+#include "nvs.h"
+#include "sdkconfig.h"
 
 #define TAG "AS7265x_DRIVER"
 
+#define AS7265X_NVS_NAMESPACE     "storage"
+#define AS7265X_NVS_MASK_KEY      "ch_mask"
+
+// Canales seleccionados (bit i = canal i del buffer de salida)
+static uint32_t s_channel_mask = CONFIG_APP_CHANNEL_MASK & AS7265X_ALL_CHANNELS_MASK;
+// Máscara con la que se encendieron los LED en modo continuo
+static uint32_t s_leds_mask = 0;
+
 /********* Funciones de Bajo Nivel *********/
 
 void as72xx_write(uint8_t reg, uint8_t value)
@@ -32,6 +42,30 @@ uint16_t read_channel(uint8_t baseReg)
     return ((uint16_t)high << 8) | low;
 }
 
+// Lee los canales seleccionados del banco b (el no seleccionado queda a 0)
+static void read_bank_channels(int b, uint16_t *output_buffer)
+{
+    for (int ch = 0; ch < 6; ch++) {
+        if (s_channel_mask & (1u << (b * 6 + ch))) {
+            output_buffer[ch] = read_channel(0x08 + (ch * 2));
+        } else {
+            output_buffer[ch] = 0;
+        }
+    }
+}
+
+static void set_all_leds(uint8_t drive, uint32_t mask)
+{
+    for (uint8_t b = 0; b < 3; b++) {
+        // Bancos sin canales seleccionados: LED siempre apagado (también si
+        // estaba encendido con una máscara anterior)
+        bool selected = (mask & AS7265X_BANK_MASK(b)) != 0;
+        as72xx_write(AS7265X_DEV_SELECT_REG, b);
+        as72xx_write(AS72XX_LED_CONFIG_REG, selected ? drive : LED_DRIVE_OFF);
+    }
+    as72xx_write(AS7265X_DEV_SELECT_REG, 0x00);
+}
+
 /********* Función Principal Modificada *********/
 
 // Ahora recibe un puntero donde guardar los datos
@@ -42,6 +76,15 @@ void read_all_18_channels_with_leds(uint16_t *output_buffer)
 
     for (int b = 0; b < 3; b++)
     {
+        // 0. Banco sin canales seleccionados: ni integración ni LED
+        if (!(s_channel_mask & AS7265X_BANK_MASK(b))) {
+            for (int ch = 0; ch < 6 && output_buffer != NULL; ch++) {
+                output_buffer[idx + ch] = 0;
+            }
+            idx += 6;
+            continue;
+        }
+
         // 1. Seleccionar Sensor (Banco)
         as72xx_write(AS7265X_DEV_SELECT_REG, banks[b]);
 
@@ -66,13 +109,112 @@ void read_all_18_channels_with_leds(uint16_t *output_buffer)
         as72xx_write(AS72XX_LED_CONFIG_REG, LED_DRIVE_OFF);
 
         // 6. Leer y GUARDAR en el buffer del usuario
-        for (int ch = 0; ch < 6; ch++)
-        {
-            // Escribimos directamente en la memoria del array del main
-            if (output_buffer != NULL) {
-                output_buffer[idx] = read_channel(0x08 + (ch * 2));
+        if (output_buffer != NULL) {
+            read_bank_channels(b, &output_buffer[idx]);
+        }
+        idx += 6;
+    }
+}
+
+/********* Modo Continuo *********/
+
+void as7265x_start_continuous(uint8_t int_time)
+{
+    s_leds_mask = s_channel_mask;
+    set_all_leds(LED_DRIVE_ON, s_leds_mask);
+    as72xx_write(AS72XX_INT_T_REG, int_time);
+    as72xx_write(AS72XX_CONFIG_REG, AS72XX_GAIN_16X | AS72XX_MODE_CONTINUOUS);
+}
+
+bool as7265x_read_continuous(uint16_t *output_buffer, int timeout_ms)
+{
+    // Máscara cambiada en marcha (RPC setChannelMask): LED de los bancos
+    // nuevos encendidos y de los que salen apagados
+    uint32_t mask = s_channel_mask;
+    if (mask != s_leds_mask) {
+        set_all_leds(LED_DRIVE_ON, mask);
+        s_leds_mask = mask;
+    }
+
+    // DATA_RDY se consulta en el maestro (banco 0) y se borra al leerlo
+    as72xx_write(AS7265X_DEV_SELECT_REG, 0x00);
+
+    int waited = 0;
+    while (!(as72xx_read(AS72XX_CONFIG_REG) & AS72XX_DATA_RDY)) {
+        if (waited >= timeout_ms) {
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(5));
+        waited += 5;
+    }
+
+    for (uint8_t b = 0; b < 3; b++) {
+        if (!(mask & AS7265X_BANK_MASK(b))) {
+            for (int ch = 0; ch < 6; ch++) {
+                output_buffer[b * 6 + ch] = 0;
             }
-            idx++;
+            continue;
         }
+        as72xx_write(AS7265X_DEV_SELECT_REG, b);
+        read_bank_channels(b, &output_buffer[b * 6]);
+    }
+    return true;
+}
+
+void as7265x_stop_continuous(void)
+{
+    as72xx_write(AS7265X_DEV_SELECT_REG, 0x00);
+    as72xx_write(AS72XX_CONFIG_REG, AS72XX_GAIN_16X);
+    set_all_leds(LED_DRIVE_OFF, 0);
+}
+
+/********* Máscara de Canales *********/
+
+uint32_t as7265x_get_channel_mask(void)
+{
+    return s_channel_mask;
+}
+
+esp_err_t as7265x_load_channel_mask(void)
+{
+    nvs_handle_t nvs;
+    uint32_t mask;
+    esp_err_t err = nvs_open(AS7265X_NVS_NAMESPACE, NVS_READONLY, &nvs);
+    if (err != ESP_OK) {
+        return err;
     }
-}
\ No newline at end of file
+
+    err = nvs_get_u32(nvs, AS7265X_NVS_MASK_KEY, &mask);
+    nvs_close(nvs);
+
+    if (err == ESP_OK && (mask & AS7265X_ALL_CHANNELS_MASK) != 0) {
+        s_channel_mask = mask & AS7265X_ALL_CHANNELS_MASK;
+        ESP_LOGI(TAG, "Máscara de canales desde NVS: 0x%05lx", (unsigned long)s_channel_mask);
+    }
+    return err;
+}
+
+esp_err_t as7265x_save_channel_mask(uint32_t mask)
+{
+    mask &= AS7265X_ALL_CHANNELS_MASK;
+    if (mask == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(AS7265X_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    err = nvs_set_u32(nvs, AS7265X_NVS_MASK_KEY, mask);
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+
+    if (err == ESP_OK) {
+        s_channel_mask = mask;
+    }
+    return err;
+}
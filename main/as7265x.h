@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <stdbool.h>
+#include "esp_err.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "i2c.h"
@@ -10,6 +12,10 @@
 // Definimos la cantidad total de canales para usar en el main
 #define AS7265X_TOTAL_CHANNELS    18
 
+// Máscara de canales: bit i = índice i del buffer (6 bits por banco)
+#define AS7265X_ALL_CHANNELS_MASK 0x3FFFFu
+#define AS7265X_BANK_MASK(b)      (0x3Fu << ((b) * 6))
+
 /********* Registros Virtuales *********/
 #define AS72XX_STATUS_REG         0x00
 #define AS72XX_WRITE_REG          0x01
@@ -24,6 +30,12 @@
 #define AS72XX_LED_CONFIG_REG     0x07
 #define AS7265X_DEV_SELECT_REG    0x4F
 
+/********* Configuración de medida (AS72XX_CONFIG_REG) *********/
+#define AS72XX_DATA_RDY           0x02
+#define AS72XX_GAIN_16X           0x20
+#define AS72XX_MODE_CONTINUOUS    0x08      // Bank mode 2: 6 canales continuo
+#define AS72XX_INT_TIME_DEFAULT   50        // x2.8 ms
+
 /********* Configuración de LEDs *********/
 #define LED_DRIVE_ON              0x08 
 #define LED_DRIVE_OFF             0x00
@@ -42,4 +54,49 @@ uint16_t read_channel(uint8_t baseReg);
  */
 void read_all_18_channels_with_leds(uint16_t *output_buffer);
 
+/**
+ * @brief Devuelve la máscara de canales en uso (bit i = canal i).
+ *
+ * Los bancos sin ningún canal seleccionado no se integran ni encienden
+ * su LED, y solo se leen los registros de los canales seleccionados; el
+ * resto queda a 0 en el buffer.
+ */
+uint32_t as7265x_get_channel_mask(void);
+
+/**
+ * @brief Carga de NVS la máscara que sustituye a CONFIG_APP_CHANNEL_MASK.
+ */
+esp_err_t as7265x_load_channel_mask(void);
+
+/**
+ * @brief Guarda en NVS y aplica una nueva máscara de canales.
+ *
+ * @return esp_err_t ESP_ERR_INVALID_ARG si la máscara no tiene canales.
+ */
+esp_err_t as7265x_save_channel_mask(uint32_t mask);
+
+/**
+ * @brief Pone la tríada en medida continua con los LEDs encendidos.
+ *
+ * @param int_time Tiempo de integración (unidades de 2.8 ms).
+ */
+void as7265x_start_continuous(uint8_t int_time);
+
+/**
+ * @brief Espera el siguiente DATA_RDY en modo continuo y lee los 18 canales.
+ *
+ * Si la máscara de canales ha cambiado desde la última lectura, antes
+ * enciende los LED de los bancos seleccionados y apaga los demás.
+ *
+ * @param output_buffer Array de uint16_t de tamaño 18.
+ * @param timeout_ms Tiempo máximo de espera de DATA_RDY.
+ * @return true si había datos nuevos, false si venció el timeout.
+ */
+bool as7265x_read_continuous(uint16_t *output_buffer, int timeout_ms);
+
+/**
+ * @brief Sale del modo continuo y apaga los LEDs.
+ */
+void as7265x_stop_continuous(void);
+
 #endif // AS7265X_H
\ No newline at end of file
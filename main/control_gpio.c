@@ -55,4 +55,14 @@ void control_gpio_update(float valor) {
     gpio_set_level(GPIO_PIN_A, estado_a);
     gpio_set_level(GPIO_PIN_B, estado_b);
     gpio_set_level(GPIO_PIN_C, estado_c);
-}
\ No newline at end of file
+}
+
+void control_gpio_update_masked(float valor, uint32_t mask) {
+    if (mask & (1u << CONTROL_GPIO_CHANNEL)) {
+        control_gpio_update(valor);
+        return;
+    }
+    gpio_set_level(GPIO_PIN_A, 0);
+    gpio_set_level(GPIO_PIN_B, 0);
+    gpio_set_level(GPIO_PIN_C, 0);
+}
@@ -6,11 +6,16 @@
 #ifndef CONTROL_GPIO_H
 #define CONTROL_GPIO_H
 
+#include <stdint.h>
+
 // --- CONFIGURACIÓN DE PINES (Cámbialos por los que uses) ---
 #define GPIO_PIN_A  17
 #define GPIO_PIN_B  18
 #define GPIO_PIN_C  19
 
+// Canal del AS7265x que decide las salidas (índice del buffer de 18: "A")
+#define CONTROL_GPIO_CHANNEL  12
+
 /**
  * @brief Configura los pines A, B y C como salidas digitales.
  */
@@ -22,4 +27,13 @@ void control_gpio_init(void);
  */
 void control_gpio_update(float valor);
 
+/**
+ * @brief Como control_gpio_update(), pero solo si CONTROL_GPIO_CHANNEL está
+ *        en la máscara de canales. Si no, apaga las salidas: un canal que no
+ *        se lee vale 0 y activaría siempre la alarma de valor bajo.
+ * * @param valor Valor de CONTROL_GPIO_CHANNEL.
+ * @param mask Máscara de canales activa.
+ */
+void control_gpio_update_masked(float valor, uint32_t mask);
+
 #endif // CONTROL_GPIO_H
\ No newline at end of file
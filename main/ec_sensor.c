@@ -9,11 +9,14 @@
 #include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "driver/adc.h"
 #include "driver/uart.h"
 #include "nvs_flash.h"
 #include "nvs.h"
 #include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_pm.h"
 
 static const char *TAG = "EC_SENSOR";
 
@@ -21,6 +24,7 @@ static const char *TAG = "EC_SENSOR";
 
 #define EC_ADC_CHANNEL   ADC1_CHANNEL_6  // GPIO34
 #define EC_SAMPLES       32
+#define EC_QEMU_VOLTAGE  1.20f           // QEMU no emula el ADC
 
 // Configuración UART
 #define EC_UART_PORT     UART_NUM_0
@@ -33,6 +37,20 @@ static const char *TAG = "EC_SENSOR";
 // Variable estática local para mantener el estado de la calibración
 static ec_calib_t s_ec_calib = { .a = 1.0f, .b = 0.0f, .valid = false };
 
+// Estado de la calibración en segundo plano: en RTC para que un punto
+// capturado sobreviva al deep-sleep hasta que llegue el segundo
+static RTC_DATA_ATTR ec_cal_state_t s_cal_state = EC_CAL_IDLE;
+static RTC_DATA_ATTR float s_cal_v1 = 0.0f;
+// Calibración pedida expresamente (RPC "start" o tecla en la consola): solo
+// entonces el nodo se queda despierto y conecta en cada ciclo hasta acabar
+static RTC_DATA_ATTR bool s_cal_requested = false;
+static SemaphoreHandle_t s_cal_mutex = NULL;
+static TaskHandle_t s_cal_task = NULL;
+
+// Locks de gestión de energía: solo se retienen mientras hay actividad
+static esp_pm_lock_handle_t s_adc_pm_lock = NULL;   // APB al máximo durante el muestreo
+static esp_pm_lock_handle_t s_uart_pm_lock = NULL;  // sin light sleep mientras se calibra
+
 // ---------- FUNCIONES PRIVADAS (Auxiliares) ----------
 
 // Lectura de byte no bloqueante
@@ -49,14 +67,24 @@ static int ec_uart_getchar_nonblock(void)
 // Lectura cruda de voltaje
 static float ec_read_voltage_internal(void)
 {
+#if CONFIG_APP_QEMU_OPENETH
+    return EC_QEMU_VOLTAGE;
+#else
     uint32_t sum = 0;
+    if (s_adc_pm_lock) {
+        esp_pm_lock_acquire(s_adc_pm_lock);
+    }
     for (int i = 0; i < EC_SAMPLES; i++) {
         int raw = adc1_get_raw(EC_ADC_CHANNEL);
         sum += raw;
     }
+    if (s_adc_pm_lock) {
+        esp_pm_lock_release(s_adc_pm_lock);
+    }
     float raw_avg = (float)sum / (float)EC_SAMPLES;
     // ADC 12 bits -> 3.3V
     return (raw_avg / 4095.0f) * 3.3f;
+#endif
 }
 
 // ---------- FUNCIONES PÚBLICAS ----------
@@ -80,6 +108,19 @@ void ec_sensor_init(void)
     uart_param_config(EC_UART_PORT, &uart_config);
     uart_set_pin(EC_UART_PORT, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE,
                  UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+
+    s_cal_mutex = xSemaphoreCreateMutex();
+
+    // La escucha pasiva de la consola del arranque en frío no sobrevive al
+    // deep-sleep; una calibración pedida sí se retoma
+    if (!s_cal_requested) {
+        s_cal_state = EC_CAL_IDLE;
+    }
+
+#if CONFIG_PM_ENABLE
+    esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0, "ec_adc", &s_adc_pm_lock);
+    esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "ec_uart", &s_uart_pm_lock);
+#endif
                  
     ESP_LOGI(TAG, "Sensor EC inicializado (ADC + UART).");
 }
@@ -145,57 +186,109 @@ float ec_sensor_read(float *voltage_out)
     return (s_ec_calib.a * v) + s_ec_calib.b;
 }
 
-void ec_sensor_run_interactive_calibration(void)
+// Tarea de consola: atiende '1' y '2' sin bloquear el arranque
+static void ec_calib_console_task(void *arg)
 {
-    printf("\r\n=== MODO CALIBRACION (2 puntos) ===\r\n");
-    printf("1. Pon la sonda en 1.413 mS/cm y pulsa '1' + Enter\r\n");
-
-    int ch;
-    float V1 = 0.0f;
-    float V2 = 0.0f;
-
-    // Esperar punto 1
-    while (1) {
-        ch = ec_uart_getchar_nonblock();
-        if (ch == '1') {
-            V1 = ec_read_voltage_internal();
-            printf(" -> Leido V1 = %.3f V\r\n", V1);
-            break;
+    // En light sleep la UART pierde lo que llega: se impide solo mientras se calibra
+    if (s_uart_pm_lock) {
+        esp_pm_lock_acquire(s_uart_pm_lock);
+    }
+    while (ec_sensor_calib_get_state() != EC_CAL_IDLE) {
+        int ch = ec_uart_getchar_nonblock();
+        if (ch == '1' || ch == '2') {
+            // Hay un operador en la consola: la calibración pasa a estar pedida
+            s_cal_requested = true;
+            ec_sensor_calib_capture(ch - '0');
         }
         vTaskDelay(pdMS_TO_TICKS(100));
     }
+    if (s_uart_pm_lock) {
+        esp_pm_lock_release(s_uart_pm_lock);
+    }
+    s_cal_task = NULL;
+    vTaskDelete(NULL);
+}
 
-    printf("\r\n2. Pon la sonda en 12.88 mS/cm y pulsa '2' + Enter\r\n");
+void ec_sensor_start_background_calibration(void)
+{
+    xSemaphoreTake(s_cal_mutex, portMAX_DELAY);
+    if (s_cal_state == EC_CAL_IDLE) {
+        s_cal_state = EC_CAL_WAIT_LOW;
+    }
+    xSemaphoreGive(s_cal_mutex);
 
-    // Esperar punto 2
-    while (1) {
-        ch = ec_uart_getchar_nonblock();
-        if (ch == '2') {
-            V2 = ec_read_voltage_internal();
-            printf(" -> Leido V2 = %.3f V\r\n", V2);
-            break;
-        }
-        vTaskDelay(pdMS_TO_TICKS(100));
+    if (s_cal_state == EC_CAL_WAIT_LOW) {
+        printf("\r\n=== MODO CALIBRACION (2 puntos, en segundo plano) ===\r\n");
+        printf("1. Pon la sonda en 1.413 mS/cm y pulsa '1' + Enter\r\n");
+    } else {
+        printf("\r\n2. Pon la sonda en 12.88 mS/cm y pulsa '2' + Enter\r\n");
     }
 
-    // Calcular recta
-    if (V2 - V1 == 0) {
-        printf("Error: Voltajes iguales, no se puede calibrar.\r\n");
-        return;
+    if (s_cal_task == NULL) {
+        xTaskCreate(ec_calib_console_task, "ec_calib", 3072, NULL, 2, &s_cal_task);
     }
+}
+
+void ec_sensor_request_calibration(void)
+{
+    s_cal_requested = true;
+    ec_sensor_start_background_calibration();
+}
 
-    float a = (EC_HIGH_STD - EC_LOW_STD) / (V2 - V1);
-    float b = EC_LOW_STD - (a * V1);
+bool ec_sensor_calib_requested(void)
+{
+    return s_cal_requested;
+}
 
-    s_ec_calib.a = a;
-    s_ec_calib.b = b;
-    s_ec_calib.valid = true;
+esp_err_t ec_sensor_calib_capture(int point)
+{
+    esp_err_t err = ESP_OK;
 
-    printf("\r\nCalibrado: a=%.4f, b=%.4f. Guardando...\r\n", a, b);
-    
-    if (ec_sensor_save_calib() == ESP_OK) {
-        printf("Guardado exitoso en NVS.\r\n\r\n");
+    xSemaphoreTake(s_cal_mutex, portMAX_DELAY);
+
+    if (point == 1 && s_cal_state == EC_CAL_WAIT_LOW) {
+        s_cal_v1 = ec_read_voltage_internal();
+        s_cal_state = EC_CAL_WAIT_HIGH;
+        printf(" -> Leido V1 = %.3f V\r\n", s_cal_v1);
+        printf("\r\n2. Pon la sonda en 12.88 mS/cm y pulsa '2' + Enter\r\n");
+    } else if (point == 2 && s_cal_state == EC_CAL_WAIT_HIGH) {
+        float V1 = s_cal_v1;
+        float V2 = ec_read_voltage_internal();
+        printf(" -> Leido V2 = %.3f V\r\n", V2);
+
+        // Calcular recta
+        if (V2 - V1 == 0) {
+            printf("Error: Voltajes iguales, no se puede calibrar. Repite el punto 1.\r\n");
+            s_cal_state = EC_CAL_WAIT_LOW;
+            err = ESP_FAIL;
+        } else {
+            float a = (EC_HIGH_STD - EC_LOW_STD) / (V2 - V1);
+            float b = EC_LOW_STD - (a * V1);
+
+            s_ec_calib.a = a;
+            s_ec_calib.b = b;
+            s_ec_calib.valid = true;
+            s_cal_state = EC_CAL_IDLE;
+            s_cal_requested = false;
+
+            printf("\r\nCalibrado: a=%.4f, b=%.4f. Guardando...\r\n", a, b);
+
+            if (ec_sensor_save_calib() == ESP_OK) {
+                printf("Guardado exitoso en NVS.\r\n\r\n");
+            } else {
+                printf("Error al guardar en NVS.\r\n\r\n");
+            }
+        }
     } else {
-        printf("Error al guardar en NVS.\r\n\r\n");
+        ESP_LOGW(TAG, "Punto de calibración %d fuera de secuencia (estado=%d)", point, s_cal_state);
+        err = ESP_ERR_INVALID_STATE;
     }
-}
\ No newline at end of file
+
+    xSemaphoreGive(s_cal_mutex);
+    return err;
+}
+
+ec_cal_state_t ec_sensor_calib_get_state(void)
+{
+    return s_cal_state;
+}
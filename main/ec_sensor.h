@@ -9,6 +9,13 @@
 #include <stdbool.h>
 #include "esp_err.h"
 
+// Estados de la calibración en segundo plano (2 puntos)
+typedef enum {
+    EC_CAL_IDLE = 0,    // sin calibración en curso
+    EC_CAL_WAIT_LOW,    // esperando la sonda en 1.413 mS/cm (punto '1')
+    EC_CAL_WAIT_HIGH,   // esperando la sonda en 12.88 mS/cm (punto '2')
+} ec_cal_state_t;
+
 // Estructura para almacenar los datos de calibración
 typedef struct {
     float a;     // pendiente de la recta
@@ -47,8 +54,47 @@ bool ec_sensor_is_calibrated(void);
 float ec_sensor_read(float *voltage_out);
 
 /**
- * @brief Ejecuta el proceso interactivo de calibración por consola (Bloqueante).
+ * @brief Arranca la calibración en segundo plano (no bloqueante).
+ *
+ * Pone la máquina de estados en EC_CAL_WAIT_LOW y lanza una tarea que
+ * atiende la consola UART ('1' y '2'). Los puntos también se pueden
+ * capturar por RPC con ec_sensor_calib_capture(). Mientras tanto el
+ * sensor sigue midiendo y ec_sensor_read() devuelve -1.
+ *
+ * Por sí sola es una escucha pasiva: no cuenta como calibración pedida y
+ * no se retoma tras el deep-sleep. Pulsar '1' o '2' en la consola la
+ * convierte en pedida.
+ */
+void ec_sensor_start_background_calibration(void);
+
+/**
+ * @brief Pide expresamente una calibración (RPC "start") y la arranca.
+ *
+ * La petición se guarda en RTC y se mantiene hasta completar los dos
+ * puntos, de modo que se retoma en los despertares siguientes.
+ */
+void ec_sensor_request_calibration(void);
+
+/**
+ * @brief Indica si hay una calibración pedida sin terminar.
+ *
+ * Es lo que decide si el nodo conecta y se queda despierto esperando los
+ * puntos; no tener calibración válida no basta.
+ */
+bool ec_sensor_calib_requested(void);
+
+/**
+ * @brief Captura un punto de calibración con la sonda en la disolución patrón.
+ *
+ * @param point 1 para 1.413 mS/cm, 2 para 12.88 mS/cm.
+ * @return esp_err_t ESP_OK si se aceptó el punto, ESP_ERR_INVALID_STATE si
+ *         no toca ese punto, ESP_FAIL si los voltajes no permiten calibrar.
+ */
+esp_err_t ec_sensor_calib_capture(int point);
+
+/**
+ * @brief Devuelve el estado actual de la calibración en segundo plano.
  */
-void ec_sensor_run_interactive_calibration(void);
+ec_cal_state_t ec_sensor_calib_get_state(void);
 
 #endif // EC_SENSOR_H
\ No newline at end of file
@@ -1,62 +1,168 @@
 #include "i2c.h"
+#include <stdbool.h>
 #include "esp_log.h"
+#include "esp_attr.h"
 
 static const char *TAG = "i2cm";
 
+static i2c_master_bus_handle_t s_bus = NULL;
+static i2c_master_dev_handle_t s_dev = NULL;
+
+// La bajada a 100 kHz y el reintento a 400 kHz se recuerdan entre ciclos
+// de deep-sleep
+static RTC_DATA_ATTR uint32_t s_freq_hz = I2CM_FREQ_HZ;
+static RTC_DATA_ATTR uint32_t s_clean_windows = 0;
+static RTC_DATA_ATTR uint32_t s_retry_windows = I2CM_RETRY_WINDOWS;
+static RTC_DATA_ATTR bool s_retrying = false;   // primera ventana tras reintentar 400 kHz
+
+// En modo asíncrono los buffers de escritura deben seguir vivos hasta que
+// el driver ejecute la transacción: se usa un anillo mayor que la cola
+static uint8_t s_wr_ring[2 * I2CM_QUEUE_DEPTH][2];
+static uint8_t s_wr_idx = 0;
+
+// Estadística de errores para el respaldo a baja velocidad
+static volatile uint32_t s_err_count = 0;
+static uint32_t s_trans_count = 0;
+
+/* Callback de fin de transacción (contexto ISR) */
+static bool IRAM_ATTR i2cm_on_trans_done(i2c_master_dev_handle_t dev,
+                                         const i2c_master_event_data_t *evt, void *arg)
+{
+    if (evt->event != I2C_EVENT_DONE) {
+        s_err_count++;
+    }
+    return false;
+}
+
+static void i2cm_add_device(uint32_t freq_hz)
+{
+    i2c_device_config_t dev_cfg = {
+        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+        .device_address = AS7265X_I2C_ADDR,
+        .scl_speed_hz = freq_hz,
+    };
+    ESP_ERROR_CHECK(i2c_master_bus_add_device(s_bus, &dev_cfg, &s_dev));
+
+    i2c_master_event_callbacks_t cbs = {
+        .on_trans_done = i2cm_on_trans_done,
+    };
+    ESP_ERROR_CHECK(i2c_master_register_event_callbacks(s_dev, &cbs, NULL));
+}
+
+static void i2cm_set_freq(uint32_t freq_hz)
+{
+    i2c_master_bus_wait_all_done(s_bus, -1);
+    ESP_ERROR_CHECK(i2c_master_bus_rm_device(s_dev));
+    s_freq_hz = freq_hz;
+    i2cm_add_device(s_freq_hz);
+}
+
+/*
+ * Cuenta una transacción y, al cerrar cada ventana, baja la velocidad si
+ * el ratio de errores es alto o la vuelve a subir tras bastantes ventanas
+ * limpias a baja velocidad
+ */
+static void i2cm_track(esp_err_t ret)
+{
+    if (ret != ESP_OK) {
+        s_err_count++;
+    }
+    if (++s_trans_count < I2CM_ERR_WINDOW) {
+        return;
+    }
+
+    if (s_freq_hz != I2CM_FREQ_SAFE_HZ) {
+        if (s_err_count >= I2CM_ERR_MAX) {
+            ESP_LOGW(TAG, "%lu errores en %d transacciones, bajando bus a %d Hz",
+                     (unsigned long)s_err_count, I2CM_ERR_WINDOW, I2CM_FREQ_SAFE_HZ);
+            if (s_retrying && s_retry_windows < I2CM_RETRY_WINDOWS_MAX) {
+                s_retry_windows *= 2;
+            }
+            s_clean_windows = 0;
+            i2cm_set_freq(I2CM_FREQ_SAFE_HZ);
+        } else if (s_retrying) {
+            // El reintento ha aguantado una ventana: se restablece la espera
+            s_retry_windows = I2CM_RETRY_WINDOWS;
+        }
+        s_retrying = false;
+    } else if (s_err_count > 0) {
+        s_clean_windows = 0;
+    } else if (++s_clean_windows >= s_retry_windows) {
+        ESP_LOGI(TAG, "%lu ventanas sin errores, reintentando %d Hz",
+                 (unsigned long)s_clean_windows, I2CM_FREQ_HZ);
+        s_clean_windows = 0;
+        s_retrying = true;
+        i2cm_set_freq(I2CM_FREQ_HZ);
+    }
+    s_err_count = 0;
+    s_trans_count = 0;
+}
+
 /* Inicializa el bus I2C como master */
 void i2cm_init(void)
 {
-    i2c_config_t conf = {
-        .mode = I2C_MODE_MASTER,
+    i2c_master_bus_config_t bus_cfg = {
+        .i2c_port = I2CM_PORT,
         .sda_io_num = I2CM_SDA_PIN,
-        .sda_pullup_en = GPIO_PULLUP_ENABLE,
         .scl_io_num = I2CM_SCL_PIN,
-        .scl_pullup_en = GPIO_PULLUP_ENABLE,
-        .master.clk_speed = I2CM_FREQ_HZ,
+        .clk_source = I2C_CLK_SRC_DEFAULT,
+        .glitch_ignore_cnt = 7,
+        .trans_queue_depth = I2CM_QUEUE_DEPTH,
+        .flags.enable_internal_pullup = true,
     };
 
-    ESP_ERROR_CHECK(i2c_param_config(I2CM_PORT, &conf));
-    ESP_ERROR_CHECK(i2c_driver_install(I2CM_PORT, conf.mode, 0, 0, 0));
+    ESP_ERROR_CHECK(i2c_new_master_bus(&bus_cfg, &s_bus));
+    i2cm_add_device(s_freq_hz);
 
-    ESP_LOGI(TAG, "I2C master inicializado (SDA=%d, SCL=%d)", I2CM_SDA_PIN, I2CM_SCL_PIN);
+    ESP_LOGI(TAG, "I2C master inicializado (SDA=%d, SCL=%d, %lu Hz)",
+             I2CM_SDA_PIN, I2CM_SCL_PIN, (unsigned long)s_freq_hz);
 }
 
-/*  Escribe en un registro físico del AS7265x */
+/*  Escribe en un registro físico del AS7265x (encolado) */
 void i2cm_write(uint8_t reg, uint8_t data)
 {
-    uint8_t buffer[2] = { reg, data };
+    uint8_t *buffer = s_wr_ring[s_wr_idx];
+    s_wr_idx = (s_wr_idx + 1) % (2 * I2CM_QUEUE_DEPTH);
+    buffer[0] = reg;
+    buffer[1] = data;
 
-    esp_err_t ret = i2c_master_write_to_device(
-        I2CM_PORT,
-        AS7265X_I2C_ADDR,
-        buffer,
-        sizeof(buffer),
-        pdMS_TO_TICKS(100)
-    );
+    esp_err_t ret = i2c_master_transmit(s_dev, buffer, 2, I2CM_TIMEOUT_MS);
 
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Error en escritura I2C: reg=0x%02X", reg);
     }
+    i2cm_track(ret);
 }
 
 /* Lee un registro físico del AS7265x */
 uint8_t i2cm_read(uint8_t reg)
 {
-    uint8_t data = 0;
+    static uint8_t wr;
+    static uint8_t data;
 
-    esp_err_t ret = i2c_master_write_read_device(
-        I2CM_PORT,
-        AS7265X_I2C_ADDR,
-        &reg,
-        1,
-        &data,
-        1,
-        pdMS_TO_TICKS(100)
-    );
+    wr = reg;
+    data = 0;
+
+    esp_err_t ret = i2c_master_transmit_receive(s_dev, &wr, 1, &data, 1, I2CM_TIMEOUT_MS);
+    if (ret == ESP_OK) {
+        // La lectura necesita el resultado: esperamos a vaciar la cola
+        ret = i2c_master_bus_wait_all_done(s_bus, I2CM_TIMEOUT_MS * (I2CM_QUEUE_DEPTH + 1));
+    }
 
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Error en lectura I2C: reg=0x%02X", reg);
     }
+    i2cm_track(ret);
 
     return data;
-}
\ No newline at end of file
+}
+
+void i2cm_flush(void)
+{
+    i2c_master_bus_wait_all_done(s_bus, -1);
+}
+
+uint32_t i2cm_get_freq_hz(void)
+{
+    return s_freq_hz;
+}
@@ -2,14 +2,30 @@
 #define I2C_INTERFACE_H
 
 #include <stdint.h>
-#include "driver/i2c.h"
+#include "driver/i2c_master.h"
 
 // ===== CONFIGURACIÓN DEL BUS I2C =====
 
 #define I2CM_SDA_PIN           21
 #define I2CM_SCL_PIN           22
 #define I2CM_PORT              I2C_NUM_0
-#define I2CM_FREQ_HZ           100000      // 100 kHz
+#define I2CM_FREQ_HZ           400000      // 400 kHz (Fast-mode)
+#define I2CM_FREQ_SAFE_HZ      100000      // 100 kHz (respaldo para cables largos)
+#define I2CM_TIMEOUT_MS        20          // Timeout por transacción
+
+// Transacciones encoladas en el driver (modo asíncrono)
+#define I2CM_QUEUE_DEPTH       8
+
+// Si en una ventana de I2CM_ERR_WINDOW transacciones hay I2CM_ERR_MAX
+// errores o más, se baja el bus a I2CM_FREQ_SAFE_HZ
+#define I2CM_ERR_WINDOW        64
+#define I2CM_ERR_MAX           4
+
+// Tras I2CM_RETRY_WINDOWS ventanas sin errores a 100 kHz se vuelve a probar
+// 400 kHz. Si falla en la primera ventana, la espera se duplica (hasta
+// I2CM_RETRY_WINDOWS_MAX) para no oscilar con un cable marginal
+#define I2CM_RETRY_WINDOWS     32
+#define I2CM_RETRY_WINDOWS_MAX 1024
 
 // Dirección del AS7265x (modo I2C virtual register)
 #define AS7265X_I2C_ADDR       0x49
@@ -17,13 +33,17 @@
 // ===== PROTOTIPOS =====
 
 /**
- * @brief Inicializa el bus I2C como master
+ * @brief Inicializa el bus I2C como master (driver i2c_master, modo asíncrono)
  */
 void i2cm_init(void);
 
 /**
  * @brief Escribe un byte en un registro físico del AS7265x
  *
+ * La escritura se encola y la función vuelve sin esperar a que termine;
+ * las transacciones se ejecutan en orden, así que la siguiente lectura
+ * ve su efecto.
+ *
  * @param reg Dirección de registro
  * @param data Dato a escribir
  */
@@ -32,9 +52,21 @@ void i2cm_write(uint8_t reg, uint8_t data);
 /**
  * @brief Lee un byte de un registro físico del AS7265x
  *
+ * Espera a que se completen todas las transacciones encoladas.
+ *
  * @param reg Dirección del registro
  * @return uint8_t Byte leído
  */
 uint8_t i2cm_read(uint8_t reg);
 
-#endif
\ No newline at end of file
+/**
+ * @brief Espera a que el bus termine todas las transacciones encoladas.
+ */
+void i2cm_flush(void);
+
+/**
+ * @brief Devuelve la frecuencia de reloj SCL actualmente en uso.
+ */
+uint32_t i2cm_get_freq_hz(void);
+
+#endif
@@ -0,0 +1,108 @@
+/*
+ * i2c_stub.c
+ * Bus I2C simulado (CONFIG_APP_I2C_STUB). Sustituye a i2c.c y emula el
+ * protocolo de registros virtuales del AS7265x sin hardware, para poder
+ * ejecutar el firmware y las medidas de rendimiento en QEMU.
+ */
+
+#include "i2c.h"
+#include "as7265x.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "i2cm_stub";
+
+#define STUB_INT_T_STEP_US  2800        // cada unidad de INT_T son 2.8 ms
+
+// Estado del protocolo de registros virtuales
+static uint8_t s_vreg = 0;          // registro virtual direccionado
+static bool    s_expect_value = false;
+static uint8_t s_vregs[0x80] = {    // contenido de los registros virtuales
+    [AS72XX_INT_T_REG] = 0xFF,      // valor de reset del sensor
+};
+static uint8_t s_bank = 0;
+static int64_t s_ready_at_us = 0;   // fin de la integración en curso
+
+// ---------- FUNCIONES PRIVADAS (Auxiliares) ----------
+
+// Nueva integración: DATA_RDY tras INT_T x 2.8 ms
+static void start_integration(void)
+{
+    uint8_t int_t = s_vregs[AS72XX_INT_T_REG] ? s_vregs[AS72XX_INT_T_REG] : 1;
+    s_ready_at_us = esp_timer_get_time() + (int64_t)int_t * STUB_INT_T_STEP_US;
+}
+
+static bool data_ready(void)
+{
+#if CONFIG_APP_I2C_STUB_INSTANT
+    return true;
+#else
+    if (esp_timer_get_time() < s_ready_at_us) {
+        return false;
+    }
+    // Leer DATA_RDY lo borra y el sensor empieza la siguiente integración
+    start_integration();
+    return true;
+#endif
+}
+
+// ---------- FUNCIONES PÚBLICAS ----------
+
+void i2cm_init(void)
+{
+    ESP_LOGW(TAG, "Bus I2C simulado: los datos del AS7265x son sintéticos");
+}
+
+void i2cm_write(uint8_t reg, uint8_t data)
+{
+    if (reg != AS72XX_WRITE_REG) {
+        return;
+    }
+
+    if (s_expect_value) {
+        // Segundo byte de una escritura virtual
+        s_vregs[s_vreg] = data;
+        if (s_vreg == AS7265X_DEV_SELECT_REG) {
+            s_bank = data;
+        } else if (s_vreg == AS72XX_CONFIG_REG || s_vreg == AS72XX_INT_T_REG) {
+            start_integration();
+        }
+        s_expect_value = false;
+    } else if (data & 0x80) {
+        s_vreg = data & 0x7F;
+        s_expect_value = true;
+    } else {
+        s_vreg = data;
+    }
+}
+
+uint8_t i2cm_read(uint8_t reg)
+{
+    if (reg == AS72XX_STATUS_REG) {
+        // Nunca ocupado para escribir, siempre hay dato para leer
+        return AS72XX_RX_VALID;
+    }
+    if (reg != AS72XX_READ_REG) {
+        return 0;
+    }
+
+    if (s_vreg == AS72XX_CONFIG_REG) {
+        return s_vregs[AS72XX_CONFIG_REG] | (data_ready() ? AS72XX_DATA_RDY : 0);
+    }
+    if (s_vreg >= 0x08 && s_vreg < 0x14) {
+        // Canal = (reg - 0x08) / 2; valor determinista por banco y canal
+        uint16_t value = 1000 + s_bank * 100 + ((s_vreg - 0x08) / 2) * 10;
+        return (s_vreg & 1) ? (value & 0xFF) : (value >> 8);
+    }
+    return s_vregs[s_vreg & 0x7F];
+}
+
+void i2cm_flush(void)
+{
+}
+
+uint32_t i2cm_get_freq_hz(void)
+{
+    return 0;
+}
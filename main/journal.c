@@ -0,0 +1,394 @@
+/*
+ * journal.c
+ * Diario de telemetría en la partición "journal".
+ *
+ * Formato: la partición se usa como anillo de sectores de 4 KB. Cada
+ * registro es una cabecera con CRC seguida del payload binario, alineado a
+ * 4 bytes.
+ * Un registro nunca cruza un sector; cuando no cabe se salta al siguiente,
+ * que se borra justo antes de escribir en él. Así cada sector se borra una
+ * vez por vuelta (desgaste repartido) y solo se añade al final.
+ *
+ * Un registro enviado se marca poniendo a 0 su campo "state", lo que en
+ * flash no necesita borrado. Si se corta la alimentación a mitad de una
+ * escritura, el CRC no coincide y el escaneo en frío descarta ese hueco.
+ */
+
+#include "journal.h"
+
+#include <stddef.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "esp_partition.h"
+#include "esp_system.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+
+static const char *TAG = "JOURNAL";
+
+#define JOURNAL_SECTOR_SIZE   4096
+#define JOURNAL_MAX_INFLIGHT  8
+#define JOURNAL_ACK_QUEUE_LEN 16
+
+#define REC_MAGIC             0x4A524E32u   // "JRN2" (los "JRNL" con JSON se ignoran)
+#define STATE_MAGIC           0x4A535441u   // "JSTA"
+#define REC_STATE_PENDING     0xFFFFFFFFu   // valor de flash borrada
+#define REC_STATE_SENT        0x00000000u
+
+#define ALIGN4(x)             (((x) + 3u) & ~3u)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+    int64_t  ts_ms;
+    uint32_t len;         // bytes de payload
+    uint32_t crc;         // CRC32 de seq, ts_ms, len y payload
+    uint32_t state;       // REC_STATE_PENDING / REC_STATE_SENT
+    uint32_t reserved;
+} journal_hdr_t;
+
+#define REC_SIZE(len)         ALIGN4(sizeof(journal_hdr_t) + (len))
+
+// Estado del anillo. En RTC para no reescanear la flash en cada despertar
+typedef struct {
+    uint32_t magic;
+    uint32_t part_addr;
+    uint32_t head;        // offset donde se escribirá el siguiente registro
+    uint32_t tail;        // cursor de reenvío: primer registro pendiente
+    uint32_t next_seq;
+    uint32_t tail_seq;    // secuencia del registro en tail (== next_seq si vacío)
+} journal_state_t;
+
+static RTC_DATA_ATTR journal_state_t s_st;
+
+static const esp_partition_t *s_part = NULL;
+static QueueHandle_t s_ack_queue = NULL;
+
+// Registros publicados a la espera de PUBACK
+static struct {
+    int      msg_id;
+    uint32_t off;
+    bool     acked;
+} s_inflight[JOURNAL_MAX_INFLIGHT];
+static int s_inflight_n = 0;
+
+static uint8_t s_buf[REC_SIZE(JOURNAL_MAX_PAYLOAD)] __attribute__((aligned(8)));
+
+// ---------- FUNCIONES PRIVADAS (Auxiliares) ----------
+
+static uint32_t rec_crc(const journal_hdr_t *h, const uint8_t *payload)
+{
+    // seq, ts_ms y len son contiguos en la cabecera
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)&h->seq,
+                                    offsetof(journal_hdr_t, crc) - offsetof(journal_hdr_t, seq));
+    return esp_rom_crc32_le(crc, payload, h->len);
+}
+
+static uint32_t sector_next(uint32_t off)
+{
+    return ((off / JOURNAL_SECTOR_SIZE + 1) * JOURNAL_SECTOR_SIZE) % s_part->size;
+}
+
+static uint32_t record_next(uint32_t off, const journal_hdr_t *h)
+{
+    return (off + REC_SIZE(h->len)) % s_part->size;
+}
+
+static bool read_hdr(uint32_t off, journal_hdr_t *h)
+{
+    if (off % JOURNAL_SECTOR_SIZE + sizeof(*h) > JOURNAL_SECTOR_SIZE) {
+        return false;
+    }
+    if (esp_partition_read(s_part, off, h, sizeof(*h)) != ESP_OK) {
+        return false;
+    }
+    return h->magic == REC_MAGIC && h->len <= JOURNAL_MAX_PAYLOAD &&
+           off % JOURNAL_SECTOR_SIZE + REC_SIZE(h->len) <= JOURNAL_SECTOR_SIZE;
+}
+
+/* Lee el payload en s_buf y comprueba el CRC */
+static bool read_payload(uint32_t off, const journal_hdr_t *h)
+{
+    if (esp_partition_read(s_part, off + sizeof(*h), s_buf, h->len) != ESP_OK) {
+        return false;
+    }
+    return rec_crc(h, s_buf) == h->crc;
+}
+
+/*
+ * Sitúa *off en el siguiente registro válido sin pasar de head. El resto
+ * de un sector sin registro válido se salta.
+ */
+static bool locate(uint32_t *off, journal_hdr_t *h)
+{
+    uint32_t sectors = s_part->size / JOURNAL_SECTOR_SIZE;
+
+    for (uint32_t i = 0; i <= sectors; i++) {
+        if (*off == s_st.head) {
+            return false;
+        }
+        if (read_hdr(*off, h)) {
+            return true;
+        }
+        *off = sector_next(*off);
+    }
+    return false;
+}
+
+/* Avanza el cursor de reenvío hasta el primer registro pendiente */
+static void advance_tail(void)
+{
+    journal_hdr_t h;
+    uint32_t off = s_st.tail;
+
+    while (locate(&off, &h)) {
+        if (h.state == REC_STATE_PENDING) {
+            s_st.tail = off;
+            s_st.tail_seq = h.seq;
+            return;
+        }
+        off = record_next(off, &h);
+    }
+    s_st.tail = s_st.head;
+    s_st.tail_seq = s_st.next_seq;
+}
+
+static void mark_sent(uint32_t off)
+{
+    uint32_t sent = REC_STATE_SENT;
+    esp_partition_write(s_part, off + offsetof(journal_hdr_t, state), &sent, sizeof(sent));
+}
+
+/* Reconstruye el estado recorriendo la partición (arranque en frío) */
+static void journal_scan(void)
+{
+    uint32_t sectors = s_part->size / JOURNAL_SECTOR_SIZE;
+    int head_sec = -1;
+    int old_sec = -1;
+    uint32_t max_seq = 0;
+    uint32_t min_seq = UINT32_MAX;
+    journal_hdr_t h;
+
+    // 1. Primer registro de cada sector: el de mayor secuencia es la cabeza
+    for (uint32_t s = 0; s < sectors; s++) {
+        if (!read_hdr(s * JOURNAL_SECTOR_SIZE, &h)) {
+            continue;
+        }
+        if (head_sec < 0 || h.seq > max_seq) {
+            head_sec = s;
+            max_seq = h.seq;
+        }
+        if (old_sec < 0 || h.seq < min_seq) {
+            old_sec = s;
+            min_seq = h.seq;
+        }
+    }
+
+    memset(&s_st, 0, sizeof(s_st));
+    s_st.part_addr = s_part->address;
+    s_st.next_seq = 1;
+    s_st.tail_seq = 1;
+
+    if (head_sec < 0) {
+        s_st.magic = STATE_MAGIC;
+        return;
+    }
+
+    // 2. Recorrer el sector cabeza hasta el final de los datos íntegros
+    uint32_t off = head_sec * JOURNAL_SECTOR_SIZE;
+    uint32_t last_seq = max_seq;
+    while (read_hdr(off, &h) && read_payload(off, &h)) {
+        last_seq = h.seq;
+        off += REC_SIZE(h.len);
+        if (off % JOURNAL_SECTOR_SIZE == 0) {
+            break;
+        }
+    }
+
+    // Escritura a medias: el resto del sector no está borrado, se abandona
+    uint32_t word = REC_STATE_PENDING;
+    if (off % JOURNAL_SECTOR_SIZE != 0 &&
+        off % JOURNAL_SECTOR_SIZE + sizeof(word) <= JOURNAL_SECTOR_SIZE) {
+        esp_partition_read(s_part, off, &word, sizeof(word));
+    }
+    if (word != REC_STATE_PENDING) {
+        ESP_LOGW(TAG, "Registro incompleto en 0x%lx, se descarta", (unsigned long)off);
+        off = sector_next(off);
+    }
+
+    s_st.head = off % s_part->size;
+    s_st.next_seq = last_seq + 1;
+
+    // 3. Cursor de reenvío: primer pendiente desde el sector más antiguo
+    s_st.tail = old_sec * JOURNAL_SECTOR_SIZE;
+    advance_tail();
+    s_st.magic = STATE_MAGIC;
+}
+
+// ---------- FUNCIONES PÚBLICAS ----------
+
+esp_err_t journal_init(void)
+{
+    s_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                      (esp_partition_subtype_t)JOURNAL_PARTITION_SUBTYPE,
+                                      JOURNAL_PARTITION_LABEL);
+    if (s_part == NULL) {
+        ESP_LOGW(TAG, "Partición '%s' no encontrada, diario desactivado", JOURNAL_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    if (s_ack_queue == NULL) {
+        s_ack_queue = xQueueCreate(JOURNAL_ACK_QUEUE_LEN, sizeof(int));
+    }
+
+    // Tras cualquier reset que no sea deep-sleep la RTC no es de fiar
+    if (esp_reset_reason() != ESP_RST_DEEPSLEEP ||
+        s_st.magic != STATE_MAGIC || s_st.part_addr != s_part->address) {
+        journal_scan();
+    }
+
+    ESP_LOGI(TAG, "Diario: head=0x%lx, seq=%lu, pendientes=%lu",
+             (unsigned long)s_st.head, (unsigned long)s_st.next_seq,
+             (unsigned long)journal_pending_count());
+    return ESP_OK;
+}
+
+esp_err_t journal_append(int64_t ts_ms, const void *data, size_t len)
+{
+    if (s_part == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (len > JOURNAL_MAX_PAYLOAD) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    uint32_t rec = REC_SIZE(len);
+    if (s_st.head % JOURNAL_SECTOR_SIZE + rec > JOURNAL_SECTOR_SIZE) {
+        s_st.head = sector_next(s_st.head);
+    }
+
+    // Sector nuevo: se borra. Si aún tenía pendientes, se pierden los más antiguos
+    if (s_st.head % JOURNAL_SECTOR_SIZE == 0) {
+        bool pending = s_st.tail_seq != s_st.next_seq;
+        if (pending && s_st.tail / JOURNAL_SECTOR_SIZE == s_st.head / JOURNAL_SECTOR_SIZE) {
+            ESP_LOGW(TAG, "Diario lleno: se sobrescriben registros pendientes");
+            s_st.tail = sector_next(s_st.head);
+            advance_tail();
+        }
+        esp_err_t err = esp_partition_erase_range(s_part, s_st.head, JOURNAL_SECTOR_SIZE);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Error borrando sector 0x%lx: %s",
+                     (unsigned long)s_st.head, esp_err_to_name(err));
+            return err;
+        }
+    }
+
+    journal_hdr_t *h = (journal_hdr_t *)s_buf;
+    memset(s_buf, 0xFF, rec);
+    h->magic = REC_MAGIC;
+    h->seq = s_st.next_seq;
+    h->ts_ms = ts_ms;
+    h->len = len;
+    memcpy(s_buf + sizeof(*h), data, len);
+    h->crc = rec_crc(h, s_buf + sizeof(*h));
+    h->state = REC_STATE_PENDING;
+
+    esp_err_t err = esp_partition_write(s_part, s_st.head, s_buf, rec);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error escribiendo registro: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    if (s_st.tail_seq == s_st.next_seq) {
+        s_st.tail = s_st.head;
+    }
+    s_st.head = (s_st.head + rec) % s_part->size;
+    s_st.next_seq++;
+    return ESP_OK;
+}
+
+int journal_replay(journal_send_fn_t send, int max_records)
+{
+    if (s_part == NULL) {
+        return 0;
+    }
+
+    journal_hdr_t h;
+    uint32_t off = s_st.tail;
+    int sent = 0;
+
+    // PUBACK de publicaciones ajenas al diario (p. ej. en directo) que
+    // llenarían la cola y harían perder los de este lote
+    if (s_inflight_n == 0) {
+        xQueueReset(s_ack_queue);
+    }
+
+    while (sent < max_records && s_inflight_n < JOURNAL_MAX_INFLIGHT && locate(&off, &h)) {
+        if (h.state == REC_STATE_PENDING) {
+            if (!read_payload(off, &h)) {
+                ESP_LOGW(TAG, "Registro %lu corrupto, se descarta", (unsigned long)h.seq);
+                mark_sent(off);
+            } else {
+                int msg_id = send(s_buf, h.len, h.ts_ms);
+                if (msg_id < 0) {
+                    break;
+                }
+                s_inflight[s_inflight_n].msg_id = msg_id;
+                s_inflight[s_inflight_n].off = off;
+                s_inflight[s_inflight_n].acked = false;
+                s_inflight_n++;
+                sent++;
+            }
+        }
+        off = record_next(off, &h);
+    }
+    return sent;
+}
+
+void journal_notify_published(int msg_id)
+{
+    if (s_ack_queue) {
+        xQueueSend(s_ack_queue, &msg_id, 0);
+    }
+}
+
+esp_err_t journal_wait_acked(int timeout_ms)
+{
+    if (s_part == NULL) {
+        return ESP_OK;
+    }
+
+    TickType_t start = xTaskGetTickCount();
+    TickType_t timeout = pdMS_TO_TICKS(timeout_ms);
+    int remaining = s_inflight_n;
+
+    while (remaining > 0) {
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        int msg_id;
+        if (elapsed >= timeout ||
+            xQueueReceive(s_ack_queue, &msg_id, timeout - elapsed) != pdTRUE) {
+            break;
+        }
+        for (int i = 0; i < s_inflight_n; i++) {
+            if (!s_inflight[i].acked && s_inflight[i].msg_id == msg_id) {
+                mark_sent(s_inflight[i].off);
+                s_inflight[i].acked = true;
+                remaining--;
+                break;
+            }
+        }
+    }
+
+    // Los no confirmados siguen pendientes y se reenviarán (al menos una vez)
+    s_inflight_n = 0;
+    advance_tail();
+    return remaining > 0 ? ESP_ERR_TIMEOUT : ESP_OK;
+}
+
+uint32_t journal_pending_count(void)
+{
+    return s_st.next_seq - s_st.tail_seq;
+}
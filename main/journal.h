@@ -0,0 +1,74 @@
+/*
+ * journal.h
+ * Diario de telemetría en flash: log circular, solo de añadido, resistente
+ * a cortes de alimentación, con reenvío ordenado cuando vuelve la conexión.
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define JOURNAL_PARTITION_LABEL   "journal"
+#define JOURNAL_PARTITION_SUBTYPE 0x40
+#define JOURNAL_MAX_PAYLOAD       512       // bytes por registro (telemetry_record_t)
+
+/**
+ * @brief Envía un registro pendiente.
+ *
+ * @param data Registro binario tal como se guardó.
+ * @param len Bytes del registro.
+ * @param ts_ms Marca de tiempo (epoch en ms) de la muestra.
+ * @return int msg_id de la publicación QoS 1 (>= 0), o -1 si falló.
+ */
+typedef int (*journal_send_fn_t)(const void *data, size_t len, int64_t ts_ms);
+
+/**
+ * @brief Monta el diario. En un arranque en frío recorre la partición para
+ *        reconstruir cabeza, secuencia y cursor de reenvío; al despertar de
+ *        deep-sleep usa el estado guardado en memoria RTC.
+ *
+ * @return esp_err_t ESP_ERR_NOT_FOUND si no existe la partición.
+ */
+esp_err_t journal_init(void);
+
+/**
+ * @brief Añade un registro binario al final del diario.
+ *
+ * Se guardan datos compactos (no el JSON) para que quepan más registros;
+ * el formato lo decide quien llama. Si el diario está lleno se sobrescribe
+ * el sector más antiguo.
+ */
+esp_err_t journal_append(int64_t ts_ms, const void *data, size_t len);
+
+/**
+ * @brief Publica registros pendientes, del más antiguo al más nuevo.
+ *
+ * @param send Función de publicación.
+ * @param max_records Máximo de registros en vuelo en esta llamada.
+ * @return int Número de registros enviados.
+ */
+int journal_replay(journal_send_fn_t send, int max_records);
+
+/**
+ * @brief Notifica el PUBACK de un mensaje (llamar desde MQTT_EVENT_PUBLISHED).
+ *
+ * No toca la flash: solo encola el msg_id para journal_wait_acked().
+ */
+void journal_notify_published(int msg_id);
+
+/**
+ * @brief Espera los PUBACK de los registros en vuelo y los marca como enviados.
+ *
+ * @return esp_err_t ESP_ERR_TIMEOUT si quedaron registros sin confirmar.
+ */
+esp_err_t journal_wait_acked(int timeout_ms);
+
+/**
+ * @brief Número de registros pendientes de envío (aproximado por secuencia).
+ */
+uint32_t journal_pending_count(void);
+
+#endif // JOURNAL_H
@@ -0,0 +1,229 @@
+/*
+ * local_http.c
+ * Servidor HTTP local con la última muestra y un histórico reciente.
+ */
+
+#include "local_http.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_http_server.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "sdkconfig.h"
+
+#include "ec_sensor.h"
+#include "telemetry.h"
+
+static const char *TAG = "LOCAL_HTTP";
+
+#define LOCAL_HTTP_HISTORY    CONFIG_APP_LOCAL_HTTP_HISTORY
+#define LOCAL_HTTP_VALUES_LEN TELEMETRY_SAMPLE_MAX_LEN
+
+static httpd_handle_t s_server = NULL;
+static SemaphoreHandle_t s_lock = NULL;
+static uint32_t s_boot_nonce = 0;   // distingue los ETag de cada arranque
+
+// Histórico circular de muestras
+static local_http_record_t s_ring[LOCAL_HTTP_HISTORY];
+static uint32_t s_ring_next = 0;    // posición de la próxima escritura
+static uint32_t s_ring_count = 0;
+
+// Copia para responder fuera del lock (el servidor atiende de una en una)
+static local_http_record_t s_snapshot[LOCAL_HTTP_HISTORY];
+
+// ---------- FUNCIONES PRIVADAS (Auxiliares) ----------
+
+/* Copia las últimas n muestras (de la más antigua a la más nueva) */
+static uint32_t snapshot_last(uint32_t n)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (n > s_ring_count) {
+        n = s_ring_count;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t idx = (s_ring_next + LOCAL_HTTP_HISTORY - n + i) % LOCAL_HTTP_HISTORY;
+        s_snapshot[i] = s_ring[idx];
+    }
+    xSemaphoreGive(s_lock);
+    return n;
+}
+
+static bool want_binary(httpd_req_t *req, const char *query)
+{
+    char fmt[8];
+    if (query && httpd_query_key_value(query, "fmt", fmt, sizeof(fmt)) == ESP_OK) {
+        return strcmp(fmt, "bin") == 0;
+    }
+
+    char accept[64];
+    if (httpd_req_get_hdr_value_str(req, "Accept", accept, sizeof(accept)) == ESP_OK) {
+        return strstr(accept, "application/octet-stream") != NULL;
+    }
+    return false;
+}
+
+/*
+ * Pone el ETag (nonce del arranque, secuencia de la última muestra, número
+ * de registros y formato). La secuencia vuelve a 0 al reiniciar; el nonce
+ * evita que un ETag anterior al reinicio coincida con uno nuevo. Devuelve
+ * true si el cliente ya la tiene (If-None-Match) y se ha respondido 304.
+ */
+static bool handle_etag(httpd_req_t *req, uint32_t seq, uint32_t n, bool binary)
+{
+    // httpd guarda el puntero hasta enviar la respuesta: no puede ir en la pila
+    static char etag[48];
+    snprintf(etag, sizeof(etag), "\"%08lx-%lu-%lu%s\"", (unsigned long)s_boot_nonce,
+             (unsigned long)seq, (unsigned long)n, binary ? "b" : "j");
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+
+    char inm[48];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", inm, sizeof(inm)) == ESP_OK &&
+        strcmp(inm, etag) == 0) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        httpd_resp_send(req, NULL, 0);
+        return true;
+    }
+    return false;
+}
+
+static esp_err_t send_records(httpd_req_t *req, uint32_t n, bool binary, bool as_array)
+{
+    if (binary) {
+        uint16_t hdr[2] = { (uint16_t)n, (uint16_t)sizeof(local_http_record_t) };
+        httpd_resp_set_type(req, "application/octet-stream");
+        httpd_resp_send_chunk(req, (const char *)hdr, sizeof(hdr));
+        httpd_resp_send_chunk(req, (const char *)s_snapshot, n * sizeof(local_http_record_t));
+        return httpd_resp_send_chunk(req, NULL, 0);
+    }
+
+    // El servidor atiende las peticiones de una en una desde su tarea
+    static char values[LOCAL_HTTP_VALUES_LEN];
+    static char entry[LOCAL_HTTP_VALUES_LEN + 48];
+    bool calibrated = ec_sensor_is_calibrated();
+
+    httpd_resp_set_type(req, "application/json");
+    if (as_array) {
+        httpd_resp_send_chunk(req, "[", 1);
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        const local_http_record_t *r = &s_snapshot[i];
+        telemetry_build_json(values, sizeof(values), r->channels,
+                             r->voltage, r->ec_value, calibrated);
+        int len = snprintf(entry, sizeof(entry), "%s{\"seq\":%lu,\"ts\":%lld,\"values\":%s}",
+                           i > 0 ? "," : "", (unsigned long)r->seq, r->ts_ms, values);
+        httpd_resp_send_chunk(req, entry, len);
+    }
+    if (as_array) {
+        httpd_resp_send_chunk(req, "]", 1);
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+// ---------- HANDLERS ----------
+
+static esp_err_t latest_get_handler(httpd_req_t *req)
+{
+    char query[32];
+    bool has_query = httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK;
+    bool binary = want_binary(req, has_query ? query : NULL);
+
+    if (snapshot_last(1) == 0) {
+        return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Sin muestras todavía");
+    }
+
+    if (handle_etag(req, s_snapshot[0].seq, 1, binary)) {
+        return ESP_OK;
+    }
+    return send_records(req, 1, binary, false);
+}
+
+static esp_err_t history_get_handler(httpd_req_t *req)
+{
+    char query[32];
+    bool has_query = httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK;
+    bool binary = want_binary(req, has_query ? query : NULL);
+
+    uint32_t n = LOCAL_HTTP_HISTORY;
+    char val[8];
+    if (has_query && httpd_query_key_value(query, "n", val, sizeof(val)) == ESP_OK) {
+        int v = atoi(val);
+        if (v > 0 && v <= LOCAL_HTTP_HISTORY) {
+            n = v;
+        }
+    }
+
+    n = snapshot_last(n);
+
+    // Sin muestras el ETag es la secuencia 0
+    if (handle_etag(req, n > 0 ? s_snapshot[n - 1].seq : 0, n, binary)) {
+        return ESP_OK;
+    }
+    return send_records(req, n, binary, true);
+}
+
+// ---------- FUNCIONES PÚBLICAS ----------
+
+esp_err_t local_http_start(void)
+{
+    if (s_server != NULL) {
+        return ESP_OK;
+    }
+
+    if (s_lock == NULL) {
+        s_lock = xSemaphoreCreateMutex();
+        s_boot_nonce = esp_random();
+    }
+
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = CONFIG_APP_LOCAL_HTTP_PORT;
+
+    esp_err_t err = httpd_start(&s_server, &config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "No se pudo arrancar el servidor HTTP: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    static const httpd_uri_t latest_uri = {
+        .uri = "/latest",
+        .method = HTTP_GET,
+        .handler = latest_get_handler,
+    };
+    static const httpd_uri_t history_uri = {
+        .uri = "/history",
+        .method = HTTP_GET,
+        .handler = history_get_handler,
+    };
+    httpd_register_uri_handler(s_server, &latest_uri);
+    httpd_register_uri_handler(s_server, &history_uri);
+
+    ESP_LOGI(TAG, "Servidor HTTP local en el puerto %d", CONFIG_APP_LOCAL_HTTP_PORT);
+    return ESP_OK;
+}
+
+void local_http_push(const stream_frame_t *frame)
+{
+    if (s_lock == NULL) {
+        return;
+    }
+
+    local_http_record_t rec = {
+        .seq = frame->seq,
+        .ts_ms = frame->ts_ms,
+        .voltage = frame->voltage,
+        .ec_value = frame->ec_value,
+    };
+    memcpy(rec.channels, frame->channels, sizeof(rec.channels));
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_ring[s_ring_next] = rec;
+    s_ring_next = (s_ring_next + 1) % LOCAL_HTTP_HISTORY;
+    if (s_ring_count < LOCAL_HTTP_HISTORY) {
+        s_ring_count++;
+    }
+    xSemaphoreGive(s_lock);
+}
@@ -0,0 +1,44 @@
+/*
+ * local_http.h
+ * Servidor HTTP local con la última muestra y un histórico reciente, para
+ * operarios o PLC en la misma red (sin pasar por ThingsBoard).
+ */
+
+#ifndef LOCAL_HTTP_H
+#define LOCAL_HTTP_H
+
+#include "esp_err.h"
+#include "stream.h"
+
+// Formato binario de un registro: little-endian, 56 bytes, sin relleno
+// (el orden de los campos evita huecos sin necesidad de empaquetar)
+typedef struct {
+    int64_t  ts_ms;
+    uint32_t seq;
+    uint16_t channels[AS7265X_TOTAL_CHANNELS];
+    float    voltage;
+    float    ec_value;
+} local_http_record_t;
+
+_Static_assert(sizeof(local_http_record_t) == 56, "formato binario de local_http");
+
+/**
+ * @brief Arranca el servidor (idempotente).
+ *
+ * Endpoints:
+ *   GET /latest           última muestra
+ *   GET /history?n=N      últimas N muestras (todas por defecto), de la más antigua a la más nueva
+ * Con ?fmt=bin (o Accept: application/octet-stream) la respuesta es binaria:
+ * cabecera uint16 número de registros + uint16 tamaño de registro, seguida de
+ * los local_http_record_t. Todas las respuestas llevan ETag con un nonce por
+ * arranque y la secuencia de la última muestra; con If-None-Match igual se
+ * responde 304 sin cuerpo.
+ */
+esp_err_t local_http_start(void);
+
+/**
+ * @brief Añade una muestra al histórico en memoria.
+ */
+void local_http_push(const stream_frame_t *frame);
+
+#endif // LOCAL_HTTP_H
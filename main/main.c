@@ -13,6 +13,7 @@
 #include "mqtt_client.h"
 #include "esp_http_client.h"
 #include "esp_wifi.h"
+#include "esp_eth.h"
 #include "esp_event.h"
 #include "esp_log.h"
 #include "esp_system.h"
@@ -22,6 +23,9 @@
 #include "esp_https_ota.h"
 #include "esp_crt_bundle.h"
 #include "esp_sntp.h"
+#include "esp_pm.h"
+#include "esp_timer.h"
+#include "cJSON.h"
 
 #include "lwip/err.h"
 #include "lwip/sys.h"
@@ -30,6 +34,20 @@
 #include "as7265x.h"
 #include "ec_sensor.h"
 #include "control_gpio.h"
+#include "telemetry.h"
+#include "stats.h"
+#include "journal.h"
+#include "wake_cycle.h"
+#include "sched.h"
+#ifdef CONFIG_APP_MQTT_TLS
+#include "mqtt_tls.h"
+#endif
+#ifdef CONFIG_APP_CONTINUOUS_MODE
+#include "stream.h"
+#endif
+#ifdef CONFIG_APP_LOCAL_HTTP
+#include "local_http.h"
+#endif
 
 
 #define DEFAULT_STA_SSID            "Galaxy S22 97D1"
@@ -45,13 +63,14 @@
 
 static const char *TAG = "AS7265x_TB";
 
-// Reemplazá con tu servidor ThingsBoard
-#define MQTT_URI "mqtt://demo.thingsboard.io"
+// Servidor ThingsBoard (mqtt:// o mqtts://, ver menuconfig)
+#define MQTT_URI CONFIG_APP_MQTT_URI
 // Token del dispositivo en ThingsBoard
 #define ACCESS_TOKEN "9q6yC6XQRkTgxoUiCWR0"
 
 #define THINGSBOARD_HOST "http://demo.thingsboard.io"
 #define TB_TELEMETRY_PATH "/api/v1/" ACCESS_TOKEN "/telemetry"  // POST JSON aquí
+#define TB_RPC_REQUEST_PREFIX "v1/devices/me/rpc/request/"
 
 // ---------------- CONFIGURACIÓN OTA ----------------
 #define OTA_URL "https://raw.githubusercontent.com/KinzCheetah24/ota-firmware/main/SBC25T04.bin"
@@ -62,31 +81,141 @@ static const char *TAG = "AS7265x_TB";
 static EventGroupHandle_t s_wifi_event_group;
 #define WIFI_CONNECTED_BIT  BIT0
 #define WIFI_FAIL_BIT       BIT1
+#define MQTT_CONNECTED_BIT  BIT2
+#define NO_UPLOAD_BIT       BIT3    // ciclo solo de adquisición: sin Wi-Fi
+
+// Espera máxima de conexión antes de dormir dejando la muestra en el diario
+#define SENSOR_CONNECT_TIMEOUT_MS   20000
+// Reenvío del diario: registros por lote y lotes máximos por despertar
+#define JOURNAL_REPLAY_BATCH        8
+#define JOURNAL_REPLAY_MAX_BATCHES  10
+#define JOURNAL_ACK_TIMEOUT_MS      5000
+// Espera máxima a la hora SNTP antes de comprobar la hora de OTA
+#define SNTP_WAIT_MS                5000
 
 static int s_retry_num = 0;
+#ifndef CONFIG_APP_CONTINUOUS_MODE
 static TaskHandle_t s_msg_task = NULL;
+#endif
 
 static esp_mqtt_client_handle_t client = NULL;
 
 uint16_t sensor_values[AS7265X_TOTAL_CHANNELS];
 
-int sensor_interval_ms = 5000;
-
-int read_interval = 15;
 static bool s_should_reconnect = true;
 
+#ifdef CONFIG_APP_CONTINUOUS_MODE
+// Reintento diferido de Wi-Fi: no se bloquea el bucle de eventos por defecto
+#define WIFI_RETRY_DELAY_MS         5000
+static esp_timer_handle_t s_wifi_retry_timer = NULL;
+
+#ifndef CONFIG_APP_QEMU_OPENETH
+static void wifi_retry_timer_cb(void *arg) {
+    esp_wifi_connect();
+}
+#endif
+#endif
+
+// DFS + light sleep automático: las esperas (DATA_RDY, PUBACK, Wi-Fi) no
+// consumen a frecuencia máxima. Cada driver retiene su lock solo mientras trabaja
+static void init_power_management(void) {
+#if CONFIG_PM_ENABLE
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = CONFIG_APP_PM_MIN_FREQ_MHZ,
+#if CONFIG_APP_QEMU_OPENETH
+        .light_sleep_enable = false,    // QEMU no emula el light sleep
+#else
+        .light_sleep_enable = true,
+#endif
+    };
+    esp_err_t err = esp_pm_configure(&pm_config);
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Gestión de energía: DFS %d-%d MHz + light sleep automático",
+                 CONFIG_APP_PM_MIN_FREQ_MHZ, CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+    } else {
+        ESP_LOGW(TAG, "No se pudo configurar esp_pm: %s", esp_err_to_name(err));
+    }
+#endif
+}
+
+#ifndef CONFIG_APP_CONTINUOUS_MODE
+// ---------- Ruta de deep-sleep (solo sin modo continuo) ----------
+
+#if CONFIG_APP_PM_PROFILE
+// Resume en una línea la tabla "Mode stats" de esp_pm_dump_locks()
+static void log_pm_mode_summary(void) {
+    static char dump[1536];
+    char summary[128];
+    size_t used = 0;
+
+    FILE *f = fmemopen(dump, sizeof(dump) - 1, "w");
+    if (!f) return;
+    esp_pm_dump_locks(f);
+    long n = ftell(f);
+    fclose(f);
+    dump[n > 0 ? n : 0] = '\0';
+
+    char *line = strstr(dump, "Mode stats:");
+    summary[0] = '\0';
+    while (line && (line = strchr(line, '\n')) != NULL) {
+        line++;
+        char name[16];
+        int pct;
+        // Formato: <modo> <MHz>M <tiempo us> <porcentaje>%
+        if (sscanf(line, "%15s %*s %*d %d%%", name, &pct) != 2) continue;
+        int w = snprintf(summary + used, sizeof(summary) - used, "%s%s %d%%",
+                         used ? ", " : "", name, pct);
+        if (w < 0 || (size_t)w >= sizeof(summary) - used) break;
+        used += w;
+    }
+    if (used > 0) ESP_LOGI(TAG, "Modos de energía: %s", summary);
+}
+#endif
+
+// Informe del ciclo: duración de la ventana despierta y reparto por modo
+static void report_power_usage(void) {
+    ESP_LOGI(TAG, "Ventana despierta: %lld ms", esp_timer_get_time() / 1000);
+#if CONFIG_APP_PM_PROFILE
+    log_pm_mode_summary();
+#endif
+}
+
 static void go_to_sleep_and_schedule(void) {
-    uint64_t sleep_time_us = (uint64_t)read_interval * 1000ULL;
+    // Un solo temporizador por intervalo: el tiempo despierto ya se descuenta
+    uint64_t interval_us = (uint64_t)sched_get_interval_s() * 1000000ULL;
+    uint64_t sleep_time_us = sched_next_sleep_us(interval_us);
+
+    report_power_usage();
 
     esp_sleep_enable_timer_wakeup(sleep_time_us);
 
-    ESP_LOGI(TAG, "Deep-sleep por %i s. Política de ahorro: "
+    ESP_LOGI(TAG, "Deep-sleep por %llu s (intervalo %lu s). Política de ahorro: "
                   "Wi-Fi sólo activo al transferir, luego hibernación.",
-                  read_interval / 1000);
+                  sleep_time_us / 1000000ULL, (unsigned long)sched_get_interval_s());
 
     esp_deep_sleep_start();
 }
 
+// Con una calibración EC pedida (RPC o consola) el operador necesita el nodo
+// despierto: el deep-sleep se retrasa hasta que termine o venza el plazo
+static void wait_for_calibration(void) {
+    if (!ec_sensor_calib_requested()) {
+        return;
+    }
+
+    ESP_LOGI(TAG, "Calibración EC pedida: despierto hasta %d s para capturar los puntos",
+             CONFIG_APP_CALIB_AWAKE_S);
+    int64_t deadline_us = esp_timer_get_time() + CONFIG_APP_CALIB_AWAKE_S * 1000000LL;
+    while (ec_sensor_calib_requested() && esp_timer_get_time() < deadline_us) {
+        vTaskDelay(pdMS_TO_TICKS(500));
+    }
+
+    if (ec_sensor_calib_requested()) {
+        ESP_LOGW(TAG, "Plazo de calibración vencido, se retoma en el siguiente despertar");
+    }
+}
+
 // Realiza la actualización de firmware
 static void perform_ota_update(void) {
     s_should_reconnect = false; 
@@ -114,30 +243,41 @@ static void perform_ota_update(void) {
         s_should_reconnect = true; 
     }
 }
+#endif // !CONFIG_APP_CONTINUOUS_MODE
 
-// Inicializa y espera sincronización de hora
+// Arranca SNTP sin esperar: el handler de eventos no debe bloquearse (MQTT
+// arranca a la vez, también en redes locales sin servidor NTP)
 static void init_sntp(void) {
+    if (sntp_enabled()) {
+        return;
+    }
     ESP_LOGI(TAG, "Inicializando SNTP...");
     sntp_setoperatingmode(SNTP_OPMODE_POLL);
     sntp_setservername(0, "pool.ntp.org");
     sntp_init();
+}
 
+#ifndef CONFIG_APP_CONTINUOUS_MODE
+// Espera (acotada) a tener hora válida; tras deep-sleep la RTC ya la conserva
+static bool wait_for_time_sync(int timeout_ms) {
     time_t now = 0;
     struct tm timeinfo = { 0 };
-    int retry = 0;
-    const int retry_count = 15;
-    while (timeinfo.tm_year < (2016 - 1900) && ++retry < retry_count) {
-        ESP_LOGI(TAG, "Esperando sincronización NTP (%d/%d)...", retry, retry_count);
-        vTaskDelay(2000 / portTICK_PERIOD_MS);
+    int64_t deadline_us = esp_timer_get_time() + timeout_ms * 1000LL;
+
+    while (1) {
         time(&now);
         localtime_r(&now, &timeinfo);
-    }
-    if (timeinfo.tm_year >= (2016 - 1900)) {
-        ESP_LOGI(TAG, "Hora sincronizada correctamente");
-    } else {
-        ESP_LOGW(TAG, "No se pudo sincronizar hora por NTP (OTA podría fallar por certs)");
+        if (timeinfo.tm_year >= (2016 - 1900)) {
+            return true;
+        }
+        if (esp_timer_get_time() >= deadline_us) {
+            ESP_LOGW(TAG, "No se pudo sincronizar hora por NTP (OTA podría fallar por certs)");
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(500));
     }
 }
+#endif
 
 void send_mqtt_data(const char *payload) {
     if (client) {
@@ -151,11 +291,106 @@ void send_mqtt_data(const char *payload) {
     }
 }
 
+_Static_assert(sizeof(telemetry_record_t) <= JOURNAL_MAX_PAYLOAD, "registro mayor que el diario");
+
+// Publica un registro binario del diario: el JSON se construye aquí, con
+// su marca de tiempo original
+static int publish_journal_record(const void *data, size_t len, int64_t ts_ms) {
+    static char values[TELEMETRY_STATS_MAX_LEN];
+    static char msg[TELEMETRY_STATS_MAX_LEN + 48];
+
+    int n = telemetry_record_to_json(values, sizeof(values), data, len);
+    if (n < 0 || n >= sizeof(values)) {
+        ESP_LOGE(TAG, "Registro de telemetría inválido (%u bytes)", (unsigned)len);
+        return -1;
+    }
+
+    if (ts_ms >= TS_VALID_MIN_MS) {
+        snprintf(msg, sizeof(msg), "{\"ts\":%lld,\"values\":%s}", ts_ms, values);
+    } else {
+        strlcpy(msg, values, sizeof(msg));
+    }
+    return esp_mqtt_client_publish(client, "v1/devices/me/telemetry", msg, 0, 1, 0);
+}
+
+#ifdef CONFIG_APP_CONTINUOUS_MODE
+static bool mqtt_online(void) {
+    return (xEventGroupGetBits(s_wifi_event_group) & MQTT_CONNECTED_BIT) != 0;
+}
+#endif
+
+/*
+ * RPC de ThingsBoard para la calibración EC:
+ *   {"method":"ecCalibrate","params":"start"}  -> inicia la calibración
+ *   {"method":"ecCalibrate","params":1|2}      -> captura el punto 1 o 2
+ * y para la máscara de canales del AS7265x (se guarda en NVS):
+ *   {"method":"setChannelMask","params":262143}
+ */
+static void handle_rpc_request(esp_mqtt_event_handle_t event)
+{
+    const char *id = event->topic + strlen(TB_RPC_REQUEST_PREFIX);
+    int id_len = event->topic_len - strlen(TB_RPC_REQUEST_PREFIX);
+    if (id_len <= 0 || id_len > 16) {
+        return;
+    }
+
+    cJSON *root = cJSON_ParseWithLength(event->data, event->data_len);
+    if (root == NULL) {
+        return;
+    }
+
+    const cJSON *method = cJSON_GetObjectItem(root, "method");
+    const cJSON *params = cJSON_GetObjectItem(root, "params");
+    esp_err_t err = ESP_ERR_NOT_SUPPORTED;
+
+    if (cJSON_IsString(method) && strcmp(method->valuestring, "ecCalibrate") == 0) {
+        if (cJSON_IsString(params) && strcmp(params->valuestring, "start") == 0) {
+            ec_sensor_request_calibration();
+            err = ESP_OK;
+        } else if (cJSON_IsNumber(params)) {
+            err = ec_sensor_calib_capture(params->valueint);
+        } else {
+            err = ESP_ERR_INVALID_ARG;
+        }
+    } else if (cJSON_IsString(method) && strcmp(method->valuestring, "setChannelMask") == 0) {
+        // Fuera de rango la conversión a uint32_t no está definida
+        double v = cJSON_IsNumber(params) ? params->valuedouble : 0.0;
+        if (v >= 1.0 && v <= (double)AS7265X_ALL_CHANNELS_MASK && v == (double)(uint32_t)v) {
+            err = as7265x_save_channel_mask((uint32_t)v);
+        } else {
+            err = ESP_ERR_INVALID_ARG;
+        }
+    }
+    cJSON_Delete(root);
+
+    char topic[64];
+    char response[96];
+    snprintf(topic, sizeof(topic), "v1/devices/me/rpc/response/%.*s", id_len, id);
+    snprintf(response, sizeof(response), "{\"result\":\"%s\",\"state\":%d,\"calibrated\":%s}",
+             esp_err_to_name(err), ec_sensor_calib_get_state(),
+             ec_sensor_is_calibrated() ? "true" : "false");
+    esp_mqtt_client_publish(client, topic, response, 0, 1, 0);
+}
+
 static esp_err_t mqtt_event_handler_cb(esp_mqtt_event_handle_t event)
 {
     switch (event->event_id) {
         case MQTT_EVENT_CONNECTED:
             ESP_LOGI(TAG, "Conectado al broker ThingsBoard");
+            esp_mqtt_client_subscribe(event->client, TB_RPC_REQUEST_PREFIX "+", 1);
+            xEventGroupSetBits(s_wifi_event_group, MQTT_CONNECTED_BIT);
+            break;
+        case MQTT_EVENT_DISCONNECTED:
+            xEventGroupClearBits(s_wifi_event_group, MQTT_CONNECTED_BIT);
+            break;
+        case MQTT_EVENT_PUBLISHED:
+            journal_notify_published(event->msg_id);
+            break;
+        case MQTT_EVENT_DATA:
+            if (event->topic_len > (int)strlen(TB_RPC_REQUEST_PREFIX) &&
+                strncmp(event->topic, TB_RPC_REQUEST_PREFIX, strlen(TB_RPC_REQUEST_PREFIX)) == 0) {
+                handle_rpc_request(event);
+            }
             break;
         default:
             break;
@@ -170,26 +405,48 @@ void mqtt_app_start(void)
         .credentials.username = ACCESS_TOKEN,
     };
 
+#ifdef CONFIG_APP_MQTT_TLS
+    // Transporte TLS propio: reanuda la sesión guardada en RTC tras deep-sleep
+    mqtt_cfg.network.transport = mqtt_tls_transport_create();
+#endif
+
     client = esp_mqtt_client_init(&mqtt_cfg);
     esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID, mqtt_event_handler_cb, client);
     esp_mqtt_client_start(client);
 }
 
+#ifndef CONFIG_APP_CONTINUOUS_MODE
 /* ---------- Tarea de sensores ---------- */
 static void sensor_task(void *arg) {
     ESP_LOGI(TAG, "Iniciando tarea de sensores");
-    char payload[600]; 
+    static telemetry_record_t record;
+    float voltage;
+    float ec_value;
+
+#if CONFIG_APP_STATS_WINDOW > 1
+    // 1-2. Ventana de adquisiciones: solo se publica el agregado
+    static stats_window_t window;
+    stats_var_t result[STATS_NUM_VARS];
+
+    ESP_LOGI(TAG, "Leyendo sensores (ventana de %d)...", CONFIG_APP_STATS_WINDOW);
+    stats_window_reset(&window);
+    do {
+        read_all_18_channels_with_leds(sensor_values);
+        ec_value = ec_sensor_read(&voltage);
+    } while (!stats_window_add(&window, sensor_values, voltage, ec_value));
+    stats_window_finalize(&window, result);
+#else
     ESP_LOGI(TAG, "Leyendo sensores...");
     
     // 1. Leer espectrometría
     read_all_18_channels_with_leds(sensor_values);
 
     // 2. Leer EC y voltaje
-    float voltage;
-    float ec_value = ec_sensor_read(&voltage);
+    ec_value = ec_sensor_read(&voltage);
+#endif
 
     if (ec_value < 0) {
-        ESP_LOGW(TAG, "Sensor EC no calibrado o error (V=%.3f)", voltage);
+        ESP_LOGW(TAG, "Sensor EC no calibrado, se publica voltaje crudo (V=%.3f)", voltage);
     } else {
         printf("Voltaje: %.3f V | EC: %.3f mS/cm\r\n", voltage, ec_value);
     }
@@ -210,61 +467,98 @@ static void sensor_task(void *arg) {
         sensor_values[12], sensor_values[13], sensor_values[14], 
         sensor_values[15], sensor_values[16], sensor_values[17]);
 
-    control_gpio_update(sensor_values[12]);
+#if CONFIG_APP_STATS_WINDOW > 1
+    control_gpio_update_masked(result[CONTROL_GPIO_CHANNEL].mean, as7265x_get_channel_mask());
 
-    // 4. Construir JSON
-    
-    int len = snprintf(payload, sizeof(payload),
-        "{"
-        "\"A\":%.2f,\"B\":%.2f,\"C\":%.2f,\"D\":%.2f,\"E\":%.2f,\"F\":%.2f,"
-        "\"G\":%.2f,\"H\":%.2f,\"I\":%.2f,\"J\":%.2f,\"K\":%.2f,\"L\":%.2f,"
-        "\"R\":%.2f,\"S\":%.2f,\"T\":%.2f,\"U\":%.2f,\"V\":%.2f,\"W\":%.2f,"
-        "\"Voltage\":%.2f,\"EC_Value\":%.2f"
-        "}",
-        (float)sensor_values[12], (float)sensor_values[13], (float)sensor_values[14], 
-        (float)sensor_values[15], (float)sensor_values[16], (float)sensor_values[17],
-        (float)sensor_values[6], (float)sensor_values[7], (float)sensor_values[8], 
-        (float)sensor_values[9], (float)sensor_values[10], (float)sensor_values[11],
-        (float)sensor_values[0], (float)sensor_values[1], (float)sensor_values[2],
-        (float)sensor_values[3], (float)sensor_values[4], (float)sensor_values[5],
-        voltage, ec_value
-    );
-
-    if (len > 0 && len < sizeof(payload)) {
-        send_mqtt_data(payload);
-        ESP_LOGI(TAG, "Esperando envío de datos...");
-        vTaskDelay(3000 / portTICK_PERIOD_MS);
-    } else {
-        ESP_LOGE(TAG, "Error: Buffer JSON demasiado pequeño");
-    }
-
-    time_t now;
-    struct tm timeinfo;
-    time(&now);
-    localtime_r(&now, &timeinfo);
+    // 4. Registro binario del agregado de la ventana (el JSON se hace al publicar)
+    size_t rec_len = telemetry_record_stats(&record, result, window.count,
+                                            ec_sensor_is_calibrated());
+#else
+    control_gpio_update_masked(sensor_values[CONTROL_GPIO_CHANNEL], as7265x_get_channel_mask());
 
-    // Debug de hora
-    // ESP_LOGI(TAG, "Hora actual: %02d:%02d:%02d", timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec);
+    // 4. Registro binario de la muestra (el JSON se hace al publicar)
+    size_t rec_len = telemetry_record_sample(&record, sensor_values, voltage, ec_value,
+                                             ec_sensor_is_calibrated());
+#endif
 
-    if (timeinfo.tm_hour == OTA_HOUR && timeinfo.tm_min == OTA_MINUTE) {
-        ESP_LOGI(TAG, "Hora programada alcanzada (%02d:%02d). Iniciando OTA...", OTA_HOUR, OTA_MINUTE);
-        
-        perform_ota_update();
+    // 5. Planificador: el intervalo sigue a la tasa de cambio de EC y espectro
+    uint32_t mask = as7265x_get_channel_mask();
+    float spectral = 0.0f;
+    int selected = 0;
+    for (int i = 0; i < AS7265X_TOTAL_CHANNELS; i++) {
+        if (mask & (1u << i)) {
+#if CONFIG_APP_STATS_WINDOW > 1
+            spectral += result[i].mean;
+#else
+            spectral += sensor_values[i];
+#endif
+            selected++;
+        }
     }
+#if CONFIG_APP_STATS_WINDOW > 1
+    float ec_trend = ec_sensor_is_calibrated() ? result[STATS_VAR_EC].mean
+                                               : result[STATS_VAR_VOLTAGE].mean;
+#else
+    float ec_trend = ec_sensor_is_calibrated() ? ec_value : voltage;
+#endif
+    sched_update(ec_trend, selected > 0 ? spectral / selected : 0.0f);
+
+    // 6. Guardar en el diario: la muestra sobrevive aunque no haya conexión
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    int64_t ts_ms = (int64_t)tv.tv_sec * 1000LL + tv.tv_usec / 1000;
+    bool journaled = journal_append(ts_ms, &record, rec_len) == ESP_OK;
+
+    // 7. Esperar al broker (o al fallo de Wi-Fi)
+    EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
+                                           MQTT_CONNECTED_BIT | WIFI_FAIL_BIT | NO_UPLOAD_BIT,
+                                           pdFALSE, pdFALSE,
+                                           pdMS_TO_TICKS(SENSOR_CONNECT_TIMEOUT_MS));
+
+    if (bits & MQTT_CONNECTED_BIT) {
+        if (journaled) {
+            // Reenvío del más antiguo al más nuevo; se marca al llegar el PUBACK
+            ESP_LOGI(TAG, "Vaciando diario (%lu pendientes)...",
+                     (unsigned long)journal_pending_count());
+            for (int b = 0; b < JOURNAL_REPLAY_MAX_BATCHES; b++) {
+                if (journal_replay(publish_journal_record, JOURNAL_REPLAY_BATCH) == 0 ||
+                    journal_wait_acked(JOURNAL_ACK_TIMEOUT_MS) != ESP_OK) {
+                    break;
+                }
+            }
+        } else if (publish_journal_record(&record, rec_len, ts_ms) >= 0) {
+            ESP_LOGI(TAG, "Esperando envío de datos...");
+            vTaskDelay(3000 / portTICK_PERIOD_MS);
+        }
 
-    go_to_sleep_and_schedule();
-
-    vTaskDelay(pdMS_TO_TICKS(sensor_interval_ms));
+        time_t now;
+        struct tm timeinfo;
+        bool time_ok = wait_for_time_sync(SNTP_WAIT_MS);
+        time(&now);
+        localtime_r(&now, &timeinfo);
 
-}
+        // Debug de hora
+        // ESP_LOGI(TAG, "Hora actual: %02d:%02d:%02d", timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec);
 
-static void stop_sensor_task_if_running(void) {
-    if (s_msg_task) {
-        ESP_LOGI(TAG, "Parando tarea sensores");
-        vTaskDelete(s_msg_task);
-        s_msg_task = NULL;
+        if (time_ok && timeinfo.tm_hour == OTA_HOUR && timeinfo.tm_min == OTA_MINUTE) {
+            ESP_LOGI(TAG, "Hora programada alcanzada (%02d:%02d). Iniciando OTA...", OTA_HOUR, OTA_MINUTE);
+            
+            perform_ota_update();
+        }
+    } else if (bits & NO_UPLOAD_BIT) {
+        ESP_LOGI(TAG, "Ciclo sin subida: muestra guardada en el diario (%lu pendientes)",
+                 (unsigned long)journal_pending_count());
+    } else {
+        ESP_LOGW(TAG, "Sin conexión: muestra guardada en el diario (%lu pendientes)",
+                 (unsigned long)journal_pending_count());
     }
+
+    // 8. No dormir a mitad de una calibración (consola/RPC)
+    wait_for_calibration();
+
+    go_to_sleep_and_schedule();
 }
+#endif // !CONFIG_APP_CONTINUOUS_MODE
 
 /* ---------- Handler de eventos Wi-Fi/IP ---------- */
 static void wifi_event_handler(void* arg, esp_event_base_t event_base,
@@ -278,13 +572,20 @@ static void wifi_event_handler(void* arg, esp_event_base_t event_base,
             case WIFI_EVENT_STA_DISCONNECTED:
                 if (s_should_reconnect) {
                     ESP_LOGW(TAG, "WIFI desconectado accidentalmente, reintentando...");
-                    stop_sensor_task_if_running();
                     if (s_retry_num < EXAMPLE_ESP_MAXIMUM_RETRY) {
                         esp_wifi_connect();
                         s_retry_num++;
                     } else {
+#ifdef CONFIG_APP_CONTINUOUS_MODE
+                        // Alimentado por red: la adquisición sigue, reintentamos sin dormir
+                        ESP_LOGE(TAG, "Fallo al conectar WiFi. Reintento en %d ms (modo continuo).",
+                                 WIFI_RETRY_DELAY_MS);
+                        esp_timer_start_once(s_wifi_retry_timer, WIFI_RETRY_DELAY_MS * 1000ULL);
+                        break;
+#endif
+                        // La tarea de sensores deja la muestra en el diario y duerme
                         ESP_LOGE(TAG, "Fallo al conectar WiFi. A dormir.");
-                        go_to_sleep_and_schedule();
+                        xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
                     }
                 } else {
                     ESP_LOGI(TAG, "WiFi desconectado intencionalmente (OTA/Sleep).");
@@ -293,27 +594,26 @@ static void wifi_event_handler(void* arg, esp_event_base_t event_base,
             default:
                 break;
         }
-    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
+    } else if (event_base == IP_EVENT &&
+               (event_id == IP_EVENT_STA_GOT_IP || event_id == IP_EVENT_ETH_GOT_IP)) {
         ip_event_got_ip_t* event = (ip_event_got_ip_t*)event_data;
-        ESP_LOGI(TAG, "STA got IP: " IPSTR, IP2STR(&event->ip_info.ip));
+        ESP_LOGI(TAG, "%s got IP: " IPSTR,
+                 event_id == IP_EVENT_ETH_GOT_IP ? "ETH" : "STA", IP2STR(&event->ip_info.ip));
         s_retry_num = 0;
         xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
 
-        init_sntp();
-        
-        mqtt_app_start();
-
-        // 1. Iniciar MQTT y Sensores (si no están corriendo)
-        if (!s_msg_task) {
-            xTaskCreate(sensor_task, "sensor_task", 4096, NULL, 5, &s_msg_task);
+        // esp-mqtt reconecta solo: el cliente se crea una única vez
+        if (client == NULL) {
+            mqtt_app_start();
         }
+
+        init_sntp();
     }
 }
 
+#ifndef CONFIG_APP_QEMU_OPENETH
 /* ---------- Inicialización Wi-Fi (STA) ---------- */
 static void wifi_init_apsta(void) {
-    s_wifi_event_group = xEventGroupCreate();
-
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
     esp_netif_create_default_wifi_sta();
@@ -324,6 +624,14 @@ static void wifi_init_apsta(void) {
     ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler, NULL));
     ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &wifi_event_handler, NULL));
 
+#ifdef CONFIG_APP_CONTINUOUS_MODE
+    const esp_timer_create_args_t retry_args = {
+        .callback = wifi_retry_timer_cb,
+        .name = "wifi_retry",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&retry_args, &s_wifi_retry_timer));
+#endif
+
     /* Configuramos la STA con credenciales por defecto */
     wifi_config_t sta_config = { 0 };
     strncpy((char*)sta_config.sta.ssid, DEFAULT_STA_SSID, sizeof(sta_config.sta.ssid) - 1);
@@ -339,6 +647,14 @@ static void wifi_init_apsta(void) {
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &sta_config));
     ESP_ERROR_CHECK(esp_wifi_start());
 
+#ifdef CONFIG_APP_CONTINUOUS_MODE
+    // Alimentado por red: sin modem sleep, el stream no espera al siguiente beacon
+    esp_wifi_set_ps(WIFI_PS_NONE);
+#else
+    // Modem sleep entre beacons: necesario para el light sleep automático con Wi-Fi
+    esp_wifi_set_ps(WIFI_PS_MIN_MODEM);
+#endif
+
     if (strlen((char*)sta_config.sta.ssid) > 0) {
         ESP_LOGI(TAG, "Trying STA connect to SSID: %s", sta_config.sta.ssid);
         esp_wifi_connect();
@@ -346,6 +662,35 @@ static void wifi_init_apsta(void) {
         ESP_LOGW(TAG, "No STA credentials provided");
     }
 }
+#endif // !CONFIG_APP_QEMU_OPENETH
+
+#if CONFIG_APP_QEMU_OPENETH
+/* ---------- Inicialización Ethernet OpenCores (solo QEMU) ---------- */
+static void eth_init_qemu(void) {
+    ESP_ERROR_CHECK(esp_netif_init());
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    esp_netif_config_t netif_cfg = ESP_NETIF_DEFAULT_ETH();
+    esp_netif_t *netif = esp_netif_new(&netif_cfg);
+
+    eth_mac_config_t mac_config = ETH_MAC_DEFAULT_CONFIG();
+    eth_phy_config_t phy_config = ETH_PHY_DEFAULT_CONFIG();
+    phy_config.reset_gpio_num = -1;
+    phy_config.autonego_timeout_ms = 100;
+    // QEMU emula la MAC OpenCores con un PHY compatible DP83848
+    esp_eth_mac_t *mac = esp_eth_mac_new_openeth(&mac_config);
+    esp_eth_phy_t *phy = esp_eth_phy_new_dp83848(&phy_config);
+
+    esp_eth_config_t eth_config = ETH_DEFAULT_CONFIG(mac, phy);
+    esp_eth_handle_t eth_handle = NULL;
+    ESP_ERROR_CHECK(esp_eth_driver_install(&eth_config, &eth_handle));
+    ESP_ERROR_CHECK(esp_netif_attach(netif, esp_eth_new_netif_glue(eth_handle)));
+
+    // Mismo manejador que el Wi-Fi: al obtener IP arrancan MQTT y SNTP
+    ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_ETH_GOT_IP, &wifi_event_handler, NULL));
+    ESP_ERROR_CHECK(esp_eth_start(eth_handle));
+    ESP_LOGW(TAG, "Red por Ethernet OpenCores (QEMU), sin Wi-Fi");
+}
+#endif
 
 void app_main(void) {
     esp_err_t ret = nvs_flash_init();
@@ -355,20 +700,71 @@ void app_main(void) {
     }
     ESP_ERROR_CHECK(ret);
 
+    init_power_management();
+    s_wifi_event_group = xEventGroupCreate();
+
+    // 1. Diario de telemetría en flash (sin partición, se publica directamente)
+    bool journal_ok = journal_init() == ESP_OK;
+
     // 2. I2C y Hardware
     i2cm_init();
     ec_sensor_init();
-
-    // 3. Cargar calibración
-    if (ec_sensor_load_calib() == ESP_OK && ec_sensor_is_calibrated()) {
-        ESP_LOGI(TAG, "Calibración cargada. Iniciando medición.");
+    as7265x_load_channel_mask();
+
+    // 3. Cargar calibración (sin bloquear: la calibración corre en segundo plano)
+    bool calibrated = ec_sensor_load_calib() == ESP_OK && ec_sensor_is_calibrated();
+    if (ec_sensor_calib_requested()) {
+        // Calibración pedida en un ciclo anterior (RPC o consola)
+        ec_sensor_start_background_calibration();
+    } else if (!calibrated && esp_reset_reason() != ESP_RST_DEEPSLEEP) {
+        // Solo en el arranque en frío se escucha la consola sin petición previa
+        ESP_LOGW(TAG, "Sin calibración válida. Pulsa '1' en la consola para calibrar "
+                      "(o RPC ecCalibrate); se publicarán voltajes sin calibrar.");
+        ec_sensor_start_background_calibration();
+    } else if (!calibrated) {
+        ESP_LOGW(TAG, "Sin calibración válida: se publican voltajes sin calibrar.");
     } else {
-        ESP_LOGW(TAG, "Sin calibración válida. Entrando en modo calibración interactiva...");
-        ec_sensor_run_interactive_calibration();
+        ESP_LOGI(TAG, "Calibración cargada. Iniciando medición.");
     }
 
     control_gpio_init();
 
-    // 4. Iniciar WiFi (Esto arrancará las tareas MQTT/HTTP/Sensor cuando conecte)
-    wifi_init_apsta();
+#ifdef CONFIG_APP_CONTINUOUS_MODE
+    bool upload = true;
+    if (!journal_ok) {
+        ESP_LOGW(TAG, "Sin partición de diario: lo adquirido durante los cortes se pierde");
+    }
+#else
+    // Sin diario o con calibración pedida siempre se conecta
+    bool upload = wake_cycle_upload_due(!journal_ok || ec_sensor_calib_requested());
+#endif
+
+    // 4. Iniciar WiFi (Esto arrancará MQTT cuando conecte)
+    if (upload) {
+#if CONFIG_APP_QEMU_OPENETH
+        eth_init_qemu();
+#else
+        wifi_init_apsta();
+#endif
+    } else {
+        xEventGroupSetBits(s_wifi_event_group, NO_UPLOAD_BIT);
+    }
+
+    // 5. La adquisición no espera a la red: corre mientras Wi-Fi conecta
+#ifdef CONFIG_APP_CONTINUOUS_MODE
+#ifdef CONFIG_APP_LOCAL_HTTP
+    // Lecturas en la red local sin pasar por el broker (antes del pipeline,
+    // para que el histórico recoja desde la primera muestra)
+    local_http_start();
+#endif
+    // Pipeline adquisición/publicación en dos núcleos (diario durante los cortes)
+    static const stream_net_t net = {
+        .publish = send_mqtt_data,
+        .publish_record = publish_journal_record,
+        .online = mqtt_online,
+    };
+    stream_start(&net);
+#else
+    xTaskCreate(sensor_task, "sensor_task", 4096, NULL, 5, &s_msg_task);
+#endif
 }
@@ -0,0 +1,325 @@
+/*
+ * mqtt_tls.c
+ * Transporte TLS propio para esp-mqtt. Se usa esp-tls directamente (en
+ * lugar del transporte SSL interno de esp-mqtt) para poder pasar y
+ * recuperar la sesión TLS, que se guarda serializada en memoria RTC.
+ * Así, al despertar de deep-sleep, la reconexión al broker reanuda la
+ * sesión con el ticket en vez de repetir el handshake completo.
+ */
+
+// Debe ir antes de cualquier include: esp_tls.h ya arrastra mbedtls/ssl.h y,
+// sin ella, MBEDTLS_PRIVATE() oculta el master secret de la sesión
+#define MBEDTLS_ALLOW_PRIVATE_ACCESS
+
+#include "mqtt_tls.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include "esp_log.h"
+#include "esp_tls.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "esp_rom_crc.h"
+#include "esp_crt_bundle.h"
+#include "sdkconfig.h"
+
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+#include "mbedtls/ssl.h"
+#endif
+
+static const char *TAG = "MQTT_TLS";
+
+typedef struct {
+    esp_tls_t *tls;
+} mqtt_tls_ctx_t;
+
+// ---------- CACHÉ DE SESIÓN EN MEMORIA RTC ----------
+
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+
+#define SESSION_MAGIC     0x544C5353u   // "TLSS"
+#define SESSION_HOST_LEN  64
+
+typedef struct {
+    uint32_t magic;
+    uint32_t crc;                       // CRC de host + len + data
+    char     host[SESSION_HOST_LEN];
+    uint32_t len;
+    uint8_t  data[CONFIG_APP_MQTT_TLS_SESSION_CACHE_SIZE];
+} rtc_tls_session_t;
+
+// Sobrevive al deep-sleep (no a un reset por alimentación)
+static RTC_NOINIT_ATTR rtc_tls_session_t s_rtc_session;
+
+static uint32_t session_crc(const rtc_tls_session_t *s)
+{
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)s->host, sizeof(s->host));
+    crc = esp_rom_crc32_le(crc, (const uint8_t *)&s->len, sizeof(s->len));
+    return esp_rom_crc32_le(crc, s->data, s->len);
+}
+
+/*
+ * Con el backend mbedTLS, esp_tls_client_session_t contiene únicamente un
+ * mbedtls_ssl_session, por lo que se puede tratar como tal para
+ * serializarla con mbedtls_ssl_session_save()/load().
+ */
+static void session_store(esp_tls_t *tls, const char *host)
+{
+    esp_tls_client_session_t *session = esp_tls_get_client_session(tls);
+    if (session == NULL) {
+        return;
+    }
+
+    size_t olen = 0;
+    int ret = mbedtls_ssl_session_save((const mbedtls_ssl_session *)session,
+                                       s_rtc_session.data, sizeof(s_rtc_session.data), &olen);
+    esp_tls_free_client_session(session);
+
+    if (ret != 0) {
+        ESP_LOGW(TAG, "Sesión TLS no cabe en RTC (%d), no se guarda", ret);
+        mqtt_tls_session_invalidate();
+        return;
+    }
+
+    strlcpy(s_rtc_session.host, host, sizeof(s_rtc_session.host));
+    s_rtc_session.len = olen;
+    s_rtc_session.crc = session_crc(&s_rtc_session);
+    s_rtc_session.magic = SESSION_MAGIC;
+    ESP_LOGI(TAG, "Sesión TLS guardada en RTC (%u bytes)", (unsigned)olen);
+}
+
+static esp_tls_client_session_t *session_restore(const char *host)
+{
+    if (s_rtc_session.magic != SESSION_MAGIC ||
+        s_rtc_session.len > sizeof(s_rtc_session.data) ||
+        strncmp(s_rtc_session.host, host, sizeof(s_rtc_session.host)) != 0 ||
+        s_rtc_session.crc != session_crc(&s_rtc_session)) {
+        return NULL;
+    }
+
+    mbedtls_ssl_session *session = calloc(1, sizeof(mbedtls_ssl_session));
+    if (session == NULL) {
+        return NULL;
+    }
+    mbedtls_ssl_session_init(session);
+
+    if (mbedtls_ssl_session_load(session, s_rtc_session.data, s_rtc_session.len) != 0) {
+        ESP_LOGW(TAG, "Sesión TLS en RTC inválida, se descarta");
+        esp_tls_free_client_session((esp_tls_client_session_t *)session);
+        mqtt_tls_session_invalidate();
+        return NULL;
+    }
+    return (esp_tls_client_session_t *)session;
+}
+
+/*
+ * En TLS 1.2 una sesión reanudada conserva el master secret de la sesión
+ * ofrecida; en un handshake completo se negocia uno nuevo. En TLS 1.3 la
+ * reanudación es por PSK y no se puede saber así.
+ */
+static const char *session_outcome(esp_tls_t *tls, const unsigned char *offered_master)
+{
+    if (offered_master == NULL) {
+        return "completo";
+    }
+    mbedtls_ssl_context *ssl = esp_tls_get_ssl_context(tls);
+    if (ssl == NULL || ssl->session == NULL) {
+        return "desconocido";
+    }
+    if (mbedtls_ssl_get_version_number(ssl) != MBEDTLS_SSL_VERSION_TLS1_2) {
+        return "TLS 1.3, reanudación no verificable";
+    }
+    return memcmp(ssl->session->master, offered_master, sizeof(ssl->session->master)) == 0
+           ? "reanudado" : "completo, el servidor rechazó el ticket";
+}
+
+void mqtt_tls_session_invalidate(void)
+{
+    s_rtc_session.magic = 0;
+}
+
+#else
+
+void mqtt_tls_session_invalidate(void)
+{
+}
+
+#endif // CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+
+// ---------- FUNCIONES DEL TRANSPORTE ----------
+
+static int tls_poll(mqtt_tls_ctx_t *ctx, int timeout_ms, bool for_read)
+{
+    int fd;
+    if (ctx->tls == NULL || esp_tls_get_conn_sockfd(ctx->tls, &fd) != ESP_OK) {
+        return -1;
+    }
+
+    fd_set set;
+    fd_set errset;
+    FD_ZERO(&set);
+    FD_ZERO(&errset);
+    FD_SET(fd, &set);
+    FD_SET(fd, &errset);
+
+    struct timeval tv = {
+        .tv_sec = timeout_ms / 1000,
+        .tv_usec = (timeout_ms % 1000) * 1000,
+    };
+
+    int ret = select(fd + 1, for_read ? &set : NULL, for_read ? NULL : &set,
+                     &errset, timeout_ms < 0 ? NULL : &tv);
+    if (ret > 0 && FD_ISSET(fd, &errset)) {
+        return -1;
+    }
+    return ret;
+}
+
+static int tls_connect(esp_transport_handle_t t, const char *host, int port, int timeout_ms)
+{
+    mqtt_tls_ctx_t *ctx = esp_transport_get_context_data(t);
+
+    esp_tls_cfg_t cfg = {
+        .crt_bundle_attach = esp_crt_bundle_attach,
+        .timeout_ms = timeout_ms,
+    };
+
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    esp_tls_client_session_t *session = session_restore(host);
+    cfg.client_session = session;
+
+    // Copia del master secret ofrecido para saber después si se reanudó
+    unsigned char offered_master[48];
+    bool offered = session != NULL;
+    if (offered) {
+        memcpy(offered_master, ((mbedtls_ssl_session *)session)->master, sizeof(offered_master));
+    }
+#endif
+
+    ctx->tls = esp_tls_init();
+    if (ctx->tls == NULL) {
+        return -1;
+    }
+
+    int64_t t0 = esp_timer_get_time();
+    int ret = esp_tls_conn_new_sync(host, strlen(host), port, &cfg, ctx->tls);
+    int64_t elapsed_ms = (esp_timer_get_time() - t0) / 1000;
+
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    if (session) {
+        esp_tls_free_client_session(session);
+    }
+#endif
+
+    if (ret <= 0) {
+        ESP_LOGE(TAG, "Fallo en handshake TLS con %s:%d", host, port);
+        esp_tls_conn_destroy(ctx->tls);
+        ctx->tls = NULL;
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+        // Si el servidor rechaza el ticket, el siguiente intento será completo
+        mqtt_tls_session_invalidate();
+#endif
+        return -1;
+    }
+
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    ESP_LOGI(TAG, "Handshake TLS (%s) en %lld ms",
+             session_outcome(ctx->tls, offered ? offered_master : NULL), elapsed_ms);
+    session_store(ctx->tls, host);
+#else
+    ESP_LOGI(TAG, "Handshake TLS en %lld ms", elapsed_ms);
+#endif
+    return 0;
+}
+
+static int tls_poll_read(esp_transport_handle_t t, int timeout_ms)
+{
+    mqtt_tls_ctx_t *ctx = esp_transport_get_context_data(t);
+    // Puede haber datos ya descifrados en el buffer de mbedTLS
+    if (ctx->tls && esp_tls_get_bytes_avail(ctx->tls) > 0) {
+        return 1;
+    }
+    return tls_poll(ctx, timeout_ms, true);
+}
+
+static int tls_poll_write(esp_transport_handle_t t, int timeout_ms)
+{
+    return tls_poll(esp_transport_get_context_data(t), timeout_ms, false);
+}
+
+static int tls_read(esp_transport_handle_t t, char *buffer, int len, int timeout_ms)
+{
+    mqtt_tls_ctx_t *ctx = esp_transport_get_context_data(t);
+
+    if (esp_tls_get_bytes_avail(ctx->tls) <= 0) {
+        int poll = tls_poll_read(t, timeout_ms);
+        if (poll <= 0) {
+            return poll == 0 ? ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT : -1;
+        }
+    }
+
+    int ret = esp_tls_conn_read(ctx->tls, (unsigned char *)buffer, len);
+    if (ret == ESP_TLS_ERR_SSL_WANT_READ || ret == ESP_TLS_ERR_SSL_WANT_WRITE) {
+        return ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+    }
+    if (ret == 0) {
+        return ERR_TCP_TRANSPORT_CONNECTION_CLOSED_BY_FIN;
+    }
+    return ret;
+}
+
+static int tls_write(esp_transport_handle_t t, const char *buffer, int len, int timeout_ms)
+{
+    mqtt_tls_ctx_t *ctx = esp_transport_get_context_data(t);
+
+    int poll = tls_poll_write(t, timeout_ms);
+    if (poll <= 0) {
+        return poll == 0 ? ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT : -1;
+    }
+
+    int ret = esp_tls_conn_write(ctx->tls, (const unsigned char *)buffer, len);
+    if (ret == ESP_TLS_ERR_SSL_WANT_READ || ret == ESP_TLS_ERR_SSL_WANT_WRITE) {
+        return 0;
+    }
+    return ret;
+}
+
+static int tls_close(esp_transport_handle_t t)
+{
+    mqtt_tls_ctx_t *ctx = esp_transport_get_context_data(t);
+    if (ctx->tls) {
+        esp_tls_conn_destroy(ctx->tls);
+        ctx->tls = NULL;
+    }
+    return 0;
+}
+
+static int tls_destroy(esp_transport_handle_t t)
+{
+    tls_close(t);
+    free(esp_transport_get_context_data(t));
+    return 0;
+}
+
+// ---------- FUNCIONES PÚBLICAS ----------
+
+esp_transport_handle_t mqtt_tls_transport_create(void)
+{
+    mqtt_tls_ctx_t *ctx = calloc(1, sizeof(mqtt_tls_ctx_t));
+    if (ctx == NULL) {
+        return NULL;
+    }
+
+    esp_transport_handle_t t = esp_transport_init();
+    if (t == NULL) {
+        free(ctx);
+        return NULL;
+    }
+
+    esp_transport_set_context_data(t, ctx);
+    esp_transport_set_default_port(t, MQTT_TLS_DEFAULT_PORT);
+    esp_transport_set_func(t, tls_connect, tls_read, tls_write, tls_close,
+                           tls_poll_read, tls_poll_write, tls_destroy);
+    return t;
+}
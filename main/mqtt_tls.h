@@ -0,0 +1,30 @@
+/*
+ * mqtt_tls.h
+ * Transporte TLS para el cliente MQTT con reanudación de sesión
+ * conservada en memoria RTC entre ciclos de deep-sleep.
+ */
+
+#ifndef MQTT_TLS_H
+#define MQTT_TLS_H
+
+#include "esp_transport.h"
+
+#define MQTT_TLS_DEFAULT_PORT   8883
+
+/**
+ * @brief Crea el transporte TLS que se pasa a esp-mqtt en network.transport.
+ *
+ * Si hay una sesión válida guardada en memoria RTC para el mismo host,
+ * la conexión la reutiliza (handshake abreviado). Tras cada handshake
+ * completo se guarda la nueva sesión.
+ *
+ * @return esp_transport_handle_t Handle del transporte, o NULL si falla.
+ */
+esp_transport_handle_t mqtt_tls_transport_create(void);
+
+/**
+ * @brief Descarta la sesión TLS guardada (la siguiente conexión será completa).
+ */
+void mqtt_tls_session_invalidate(void);
+
+#endif // MQTT_TLS_H
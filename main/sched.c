@@ -0,0 +1,207 @@
+/*
+ * sched.c
+ * Planificador adaptativo del intervalo de muestreo.
+ */
+
+#include "sched.h"
+
+#include <math.h>
+#include <time.h>
+#include <sys/time.h>
+#include "driver/adc.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "SCHED";
+
+#define SCHED_MAGIC           0x53434844u   // "SCHD"
+#define SCHED_MIN_SLEEP_S     1             // nunca se duerme menos de esto
+
+// Factores de ajuste del intervalo
+#define SCHED_SPEEDUP         0.5f          // cambio rápido: mitad de intervalo
+#define SCHED_SLOWDOWN        1.5f          // estable: intervalo x1.5
+#define SCHED_STABLE_FRACTION 0.25f         // actividad < 25% del umbral = estable
+
+// Estado persistente entre ciclos de deep-sleep
+typedef struct {
+    uint32_t magic;
+    uint32_t base_s;          // intervalo adaptado por la tasa de cambio
+    uint32_t interval_s;      // intervalo efectivo (dosificación, alimentación)
+    float    last_ec;
+    float    last_spectral;
+    int64_t  last_us;         // hora (gettimeofday) de la última muestra
+} sched_state_t;
+
+static RTC_DATA_ATTR sched_state_t s_sched;
+
+// ---------- FUNCIONES PRIVADAS (Auxiliares) ----------
+
+static int64_t now_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+// Variación relativa por minuto
+static float relative_rate(float now, float before, float minutes)
+{
+    float base = fabsf(before) > 1e-3f ? fabsf(before) : 1e-3f;
+    return fabsf(now - before) / base / minutes;
+}
+
+#if CONFIG_APP_SCHED_DOSING_START_H != CONFIG_APP_SCHED_DOSING_END_H
+// Hora UTC actual; false si el reloj aún no se ha sincronizado
+static bool utc_now(struct tm *timeinfo)
+{
+    time_t now;
+    time(&now);
+    gmtime_r(&now, timeinfo);
+    return timeinfo->tm_year >= (2016 - 1900);
+}
+#endif
+
+static bool in_dosing_window(void)
+{
+#if CONFIG_APP_SCHED_DOSING_START_H != CONFIG_APP_SCHED_DOSING_END_H
+    struct tm timeinfo;
+    if (!utc_now(&timeinfo)) {
+        return false;   // hora sin sincronizar
+    }
+
+    int h = timeinfo.tm_hour;
+    if (CONFIG_APP_SCHED_DOSING_START_H < CONFIG_APP_SCHED_DOSING_END_H) {
+        return h >= CONFIG_APP_SCHED_DOSING_START_H && h < CONFIG_APP_SCHED_DOSING_END_H;
+    }
+    // Ventana que cruza medianoche
+    return h >= CONFIG_APP_SCHED_DOSING_START_H || h < CONFIG_APP_SCHED_DOSING_END_H;
+#else
+    return false;
+#endif
+}
+
+// Microsegundos hasta el próximo inicio de la ventana de dosificación, -1 si
+// no hay ventana, la hora no está sincronizada o ya estamos dentro
+static int64_t us_until_dosing_start(void)
+{
+#if CONFIG_APP_SCHED_DOSING_START_H != CONFIG_APP_SCHED_DOSING_END_H
+    struct tm timeinfo;
+    if (!utc_now(&timeinfo) || in_dosing_window()) {
+        return -1;
+    }
+
+    int32_t now_s = timeinfo.tm_hour * 3600 + timeinfo.tm_min * 60 + timeinfo.tm_sec;
+    int32_t left_s = CONFIG_APP_SCHED_DOSING_START_H * 3600 - now_s;
+    if (left_s <= 0) {
+        left_s += 24 * 3600;
+    }
+    return (int64_t)left_s * 1000000LL;
+#else
+    return -1;
+#endif
+}
+
+// Tensión de alimentación en mV (divisor en CONFIG_APP_SUPPLY_ADC_CHANNEL), -1 si no hay
+static int read_supply_mv(void)
+{
+#if CONFIG_APP_SUPPLY_ADC_CHANNEL >= 0
+    adc1_config_channel_atten(CONFIG_APP_SUPPLY_ADC_CHANNEL, ADC_ATTEN_DB_11);
+    uint32_t sum = 0;
+    for (int i = 0; i < 16; i++) {
+        sum += adc1_get_raw(CONFIG_APP_SUPPLY_ADC_CHANNEL);
+    }
+    // ADC 12 bits -> 3.3V, luego deshacer el divisor
+    float mv = (sum / 16.0f) / 4095.0f * 3300.0f;
+    return (int)(mv * CONFIG_APP_SUPPLY_DIVIDER_X100 / 100);
+#else
+    return -1;
+#endif
+}
+
+// ---------- FUNCIONES PÚBLICAS ----------
+
+void sched_update(float ec_value, float spectral_mean)
+{
+    int64_t t = now_us();
+
+    if (s_sched.magic != SCHED_MAGIC) {
+        s_sched.magic = SCHED_MAGIC;
+        s_sched.base_s = CONFIG_APP_SCHED_DEFAULT_S;
+    } else if (t > s_sched.last_us) {
+        float minutes = (float)(t - s_sched.last_us) / 60e6f;
+        if (minutes < 1.0f / 60.0f) {
+            minutes = 1.0f / 60.0f;
+        }
+
+        // Actividad respecto al umbral (>= 1: la disolución está cambiando)
+        float ec_rate = relative_rate(ec_value, s_sched.last_ec, minutes);
+        float spec_rate = relative_rate(spectral_mean, s_sched.last_spectral, minutes);
+        float activity = fmaxf(ec_rate / (CONFIG_APP_SCHED_EC_RATE_PCT / 100.0f),
+                               spec_rate / (CONFIG_APP_SCHED_SPEC_RATE_PCT / 100.0f));
+
+        float base = (float)s_sched.base_s;
+        if (activity >= 1.0f) {
+            base *= SCHED_SPEEDUP;
+        } else if (activity < SCHED_STABLE_FRACTION) {
+            base *= SCHED_SLOWDOWN;
+        }
+        base = fminf(fmaxf(base, CONFIG_APP_SCHED_MIN_S), CONFIG_APP_SCHED_MAX_S);
+        s_sched.base_s = (uint32_t)base;
+
+        ESP_LOGI(TAG, "dEC=%.2f%%/min dEspectro=%.2f%%/min actividad=%.2f",
+                 ec_rate * 100.0f, spec_rate * 100.0f, activity);
+    }
+
+    uint32_t interval = s_sched.base_s;
+
+    if (in_dosing_window() && interval > CONFIG_APP_SCHED_DOSING_S) {
+        interval = CONFIG_APP_SCHED_DOSING_S;
+    }
+
+    int supply_mv = read_supply_mv();
+    if (supply_mv >= 0 && supply_mv < CONFIG_APP_SCHED_LOW_SUPPLY_MV) {
+        ESP_LOGW(TAG, "Alimentación baja (%d mV): se alarga el intervalo", supply_mv);
+        interval *= 2;
+    }
+
+    if (interval < CONFIG_APP_SCHED_MIN_S) {
+        interval = CONFIG_APP_SCHED_MIN_S;
+    }
+    if (interval > CONFIG_APP_SCHED_MAX_S) {
+        interval = CONFIG_APP_SCHED_MAX_S;
+    }
+
+    s_sched.interval_s = interval;
+    ESP_LOGI(TAG, "Intervalo de muestreo: %lu s", (unsigned long)interval);
+
+    s_sched.last_ec = ec_value;
+    s_sched.last_spectral = spectral_mean;
+    s_sched.last_us = t;
+}
+
+uint64_t sched_next_sleep_us(uint64_t period_us)
+{
+    // Descontar lo que llevamos despiertos desde el arranque
+    int64_t sleep_us = (int64_t)period_us - esp_timer_get_time();
+
+    // Un intervalo largo (disolución estable) no debe saltarse el inicio de
+    // la ventana de dosificación: se despierta justo al empezar
+    int64_t until_dosing_us = us_until_dosing_start();
+    if (until_dosing_us >= 0 && sleep_us > until_dosing_us) {
+        ESP_LOGI(TAG, "Sueño recortado al inicio de la ventana de dosificación (%lld s)",
+                 until_dosing_us / 1000000LL);
+        sleep_us = until_dosing_us;
+    }
+
+    if (sleep_us < SCHED_MIN_SLEEP_S * 1000000LL) {
+        sleep_us = SCHED_MIN_SLEEP_S * 1000000LL;
+    }
+    return (uint64_t)sleep_us;
+}
+
+uint32_t sched_get_interval_s(void)
+{
+    return s_sched.magic == SCHED_MAGIC ? s_sched.interval_s : CONFIG_APP_SCHED_DEFAULT_S;
+}
@@ -0,0 +1,42 @@
+/*
+ * sched.h
+ * Planificador adaptativo del intervalo de muestreo.
+ */
+
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+
+/**
+ * @brief Actualiza el intervalo con la muestra de este ciclo.
+ *
+ * El intervalo se acorta cuando la EC o el espectro cambian deprisa y se
+ * alarga cuando la disolución está estable. Dentro de la ventana de
+ * dosificación no supera CONFIG_APP_SCHED_DOSING_S, y con tensión de
+ * alimentación baja se alarga. Siempre queda entre CONFIG_APP_SCHED_MIN_S
+ * y CONFIG_APP_SCHED_MAX_S. El estado se guarda en memoria RTC.
+ *
+ * @param ec_value EC (o voltaje de la sonda si no está calibrada).
+ * @param spectral_mean Media de los canales espectrales seleccionados.
+ */
+void sched_update(float ec_value, float spectral_mean);
+
+/**
+ * @brief Tiempo del próximo deep-sleep descontando el tiempo que ya se ha
+ *        pasado despierto en este ciclo (mínimo 1 s).
+ *
+ * Fuera de la ventana de dosificación, y con la hora sincronizada, el sueño
+ * se recorta para terminar como tarde al inicio de la ventana.
+ *
+ * @param period_us Periodo deseado entre despertares.
+ * @return uint64_t Microsegundos a programar en el temporizador.
+ */
+uint64_t sched_next_sleep_us(uint64_t period_us);
+
+/**
+ * @brief Intervalo de muestreo actual en segundos.
+ */
+uint32_t sched_get_interval_s(void);
+
+#endif // SCHED_H
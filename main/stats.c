@@ -0,0 +1,103 @@
+/*
+ * stats.c
+ * Estadística por ventana de adquisiciones.
+ */
+
+#include "stats.h"
+
+#include <math.h>
+#include <string.h>
+
+// Umbral de outlier en décimas de sigma (p. ej. 30 -> 3.0 σ)
+#define STATS_OUTLIER_K     (CONFIG_APP_STATS_OUTLIER_SIGMA_X10 / 10.0f)
+
+// Con menos muestras la σ de las demás no es fiable para rechazar nada
+#define STATS_MIN_FOR_REJECT 4
+
+// Suelo de σ relativo a la media: si las demás muestras son casi idénticas
+// (σ ≈ 0), diferencias por debajo de este porcentaje no son outliers
+#define STATS_SIGMA_FLOOR_REL 0.01f
+
+static void welford_update(uint32_t *n, float *mean, float *m2, float x)
+{
+    (*n)++;
+    float delta = x - *mean;
+    *mean += delta / (float)*n;
+    *m2 += delta * (x - *mean);
+}
+
+void stats_window_reset(stats_window_t *w)
+{
+    memset(w, 0, sizeof(*w));
+}
+
+bool stats_window_add(stats_window_t *w, const uint16_t *channels, float voltage, float ec_value)
+{
+    if (w->count >= STATS_WINDOW_MAX) {
+        return true;
+    }
+
+    float *row = w->samples[w->count++];
+    for (int i = 0; i < AS7265X_TOTAL_CHANNELS; i++) {
+        row[i] = (float)channels[i];
+    }
+    row[STATS_VAR_VOLTAGE] = voltage;
+    row[STATS_VAR_EC] = ec_value;
+
+    for (int v = 0; v < STATS_NUM_VARS; v++) {
+        welford_update(&w->n[v], &w->mean[v], &w->m2[v], row[v]);
+    }
+    return w->count >= STATS_WINDOW_MAX;
+}
+
+/*
+ * Cada muestra se compara con la media y la σ de las DEMÁS muestras de la
+ * ventana (leave-one-out), obtenidas deshaciendo su paso de Welford. Con la
+ * σ de la ventana completa un punto nunca se aleja más de (n-1)/√n σ de la
+ * media (1.5 σ con n = 4), así que un umbral de 3 σ no rechazaría nada.
+ */
+static bool is_outlier(const stats_window_t *w, int v, float x)
+{
+    uint32_t n = w->n[v] - 1;
+    float mean = ((float)w->n[v] * w->mean[v] - x) / (float)n;
+    float m2 = w->m2[v] - (x - w->mean[v]) * (x - mean);
+    float sigma = m2 > 0.0f ? sqrtf(m2 / (float)(n - 1)) : 0.0f;
+    float floor = STATS_SIGMA_FLOOR_REL * fabsf(mean);
+
+    if (sigma < floor) {
+        sigma = floor;
+    }
+    return sigma > 0.0f && fabsf(x - mean) > STATS_OUTLIER_K * sigma;
+}
+
+void stats_window_finalize(const stats_window_t *w, stats_var_t *out)
+{
+    for (int v = 0; v < STATS_NUM_VARS; v++) {
+        bool reject = w->count >= STATS_MIN_FOR_REJECT;
+
+        // Segunda pasada de Welford solo con las muestras aceptadas
+        uint32_t n = 0;
+        float mean = 0.0f;
+        float m2 = 0.0f;
+        float min = INFINITY;
+        float max = -INFINITY;
+        uint16_t rejected = 0;
+
+        for (int s = 0; s < w->count; s++) {
+            float x = w->samples[s][v];
+            if (reject && is_outlier(w, v, x)) {
+                rejected++;
+                continue;
+            }
+            welford_update(&n, &mean, &m2, x);
+            if (x < min) min = x;
+            if (x > max) max = x;
+        }
+
+        out[v].mean = mean;
+        out[v].stddev = n > 1 ? sqrtf(m2 / (float)(n - 1)) : 0.0f;
+        out[v].min = n > 0 ? min : 0.0f;
+        out[v].max = n > 0 ? max : 0.0f;
+        out[v].rejected = rejected;
+    }
+}
@@ -0,0 +1,63 @@
+/*
+ * stats.h
+ * Estadística por ventana de adquisiciones: media y varianza (Welford),
+ * mínimo, máximo y rechazo de outliers para cada canal y para la EC.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "as7265x.h"
+#include "sdkconfig.h"
+
+// Variables agregadas: 18 canales + voltaje + EC
+#define STATS_VAR_VOLTAGE   AS7265X_TOTAL_CHANNELS
+#define STATS_VAR_EC        (AS7265X_TOTAL_CHANNELS + 1)
+#define STATS_NUM_VARS      (AS7265X_TOTAL_CHANNELS + 2)
+
+#define STATS_WINDOW_MAX    CONFIG_APP_STATS_WINDOW
+
+// Resultado de una variable tras cerrar la ventana
+typedef struct {
+    float    mean;
+    float    stddev;
+    float    min;
+    float    max;
+    uint16_t rejected;   // muestras descartadas como outlier
+} stats_var_t;
+
+// Estado de una ventana en curso
+typedef struct {
+    uint16_t count;
+    uint32_t n[STATS_NUM_VARS];
+    float    mean[STATS_NUM_VARS];
+    float    m2[STATS_NUM_VARS];
+    float    samples[STATS_WINDOW_MAX][STATS_NUM_VARS];
+} stats_window_t;
+
+/**
+ * @brief Vacía la ventana.
+ */
+void stats_window_reset(stats_window_t *w);
+
+/**
+ * @brief Añade una adquisición a la ventana (actualización de Welford).
+ *
+ * @return true si la ventana está llena tras añadirla.
+ */
+bool stats_window_add(stats_window_t *w, const uint16_t *channels, float voltage, float ec_value);
+
+/**
+ * @brief Cierra la ventana: descarta outliers y calcula media, desviación,
+ *        mínimo y máximo con las muestras aceptadas.
+ *
+ * Una muestra es outlier si |x - media| > k·σ, con la media y la σ de las
+ * demás muestras de la ventana. Con menos de 4 muestras no se descarta nada.
+ *
+ * @param out Array de STATS_NUM_VARS resultados.
+ */
+void stats_window_finalize(const stats_window_t *w, stats_var_t *out);
+
+#endif // STATS_H
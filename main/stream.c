@@ -0,0 +1,253 @@
+/*
+ * stream.c
+ * Modo continuo: productor (adquisición, APP_CPU) -> ring buffer ->
+ * consumidor (lotes MQTT, PRO_CPU).
+ */
+
+#include "stream.h"
+
+#include <stdio.h>
+#include <sys/time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/ringbuf.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+#include "ec_sensor.h"
+#include "control_gpio.h"
+#include "telemetry.h"
+#include "stats.h"
+#include "journal.h"
+#if CONFIG_APP_LOCAL_HTTP
+#include "local_http.h"
+#endif
+
+static const char *TAG = "STREAM";
+
+#define STREAM_STATS_PERIOD_MS    10000
+#define STREAM_BATCH_TIMEOUT_MS   1000
+// Reenvío del diario al reconectar: registros por lote y espera de PUBACK.
+// El productor sigue llenando el ring buffer mientras tanto
+#define STREAM_REPLAY_BATCH       8
+#define STREAM_REPLAY_ACK_MS      5000
+#if CONFIG_APP_STATS_WINDOW > 1
+#define STREAM_VALUES_MAX_LEN     TELEMETRY_STATS_MAX_LEN
+#else
+#define STREAM_VALUES_MAX_LEN     TELEMETRY_SAMPLE_MAX_LEN
+#endif
+// Envoltorio de cada entrada del lote: ,{"ts":<13 cifras>,"values":...}
+#define STREAM_ENTRY_WRAP_LEN     32
+#define STREAM_ENTRY_MAX_LEN      (STREAM_VALUES_MAX_LEN + STREAM_ENTRY_WRAP_LEN)
+
+static RingbufHandle_t s_ring = NULL;
+static stream_net_t s_net;
+
+// Contadores compartidos entre núcleos (escritura solo desde el productor)
+static volatile uint32_t s_produced = 0;
+static volatile uint32_t s_dropped = 0;
+
+static int64_t now_epoch_ms(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000LL + tv.tv_usec / 1000;
+}
+
+/* ---------- Productor: adquisición ---------- */
+static void stream_producer_task(void *arg)
+{
+    stream_frame_t frame = { 0 };
+
+    as7265x_start_continuous(CONFIG_APP_STREAM_INT_TIME);
+    ESP_LOGI(TAG, "Adquisición continua en núcleo %d", xPortGetCoreID());
+
+    while (1) {
+        if (!as7265x_read_continuous(frame.channels, 1000)) {
+            ESP_LOGW(TAG, "Timeout esperando DATA_RDY");
+            continue;
+        }
+        frame.ts_ms = now_epoch_ms();
+        frame.ec_value = ec_sensor_read(&frame.voltage);
+        frame.seq++;
+
+        control_gpio_update_masked(frame.channels[CONTROL_GPIO_CHANNEL], as7265x_get_channel_mask());
+
+        // Sin espera: si el consumidor no da abasto, la trama se pierde
+        if (xRingbufferSend(s_ring, &frame, sizeof(frame), 0) != pdTRUE) {
+            s_dropped++;
+        }
+        s_produced++;
+    }
+}
+
+/*
+ * Sin conexión: se guarda en el diario el primer registro de cada
+ * APP_STREAM_JOURNAL_PERIOD_S. Guardar cada trama agotaría la partición en
+ * minutos y desgastaría la flash.
+ */
+static void journal_offline(int64_t *last_us, int64_t ts_ms,
+                            const telemetry_record_t *rec, size_t len)
+{
+    int64_t now_us = esp_timer_get_time();
+    if (*last_us != 0 && now_us - *last_us < CONFIG_APP_STREAM_JOURNAL_PERIOD_S * 1000000LL) {
+        return;
+    }
+    *last_us = now_us;
+    journal_append(ts_ms, rec, len);
+}
+
+/*
+ * Añade una entrada al lote. Sin hora sincronizada se omite "ts" (la de
+ * arranque se guardaría como 1970). Si no cabe, el lote queda como estaba.
+ */
+static bool batch_append(char *payload, size_t size, int *len, int count,
+                         int64_t ts_ms, const char *values)
+{
+    const char *sep = count == 0 ? "[" : ",";
+    int w;
+    if (ts_ms >= TS_VALID_MIN_MS) {
+        w = snprintf(payload + *len, size - *len, "%s{\"ts\":%lld,\"values\":%s}",
+                     sep, ts_ms, values);
+    } else {
+        w = snprintf(payload + *len, size - *len, "%s%s", sep, values);
+    }
+    if (w < 0 || w >= (int)(size - *len)) {
+        payload[*len] = '\0';
+        ESP_LOGE(TAG, "Entrada no cabe en el lote, se descarta");
+        return false;
+    }
+    *len += w;
+    return true;
+}
+
+/* ---------- Consumidor: lotes MQTT y estadísticas ---------- */
+static void stream_consumer_task(void *arg)
+{
+    // Cada entrada completa más el cierre "]"
+    static char payload[CONFIG_APP_STREAM_BATCH * STREAM_ENTRY_MAX_LEN + 2];
+    static char values[STREAM_VALUES_MAX_LEN];
+    static telemetry_record_t record;
+    int count = 0;
+    int len = 0;
+    int64_t journal_last_us = 0;
+
+#if CONFIG_APP_STATS_WINDOW > 1
+    static stats_window_t window;
+    static stats_var_t result[STATS_NUM_VARS];
+    stats_window_reset(&window);
+#endif
+
+    int64_t stats_t0 = esp_timer_get_time();
+    uint32_t stats_produced0 = s_produced;
+
+    ESP_LOGI(TAG, "Publicación en lotes de %d en núcleo %d",
+             CONFIG_APP_STREAM_BATCH, xPortGetCoreID());
+
+    while (1) {
+        bool online = s_net.online();
+        if (online) {
+            // La próxima desconexión guarda un registro desde el principio
+            journal_last_us = 0;
+        }
+
+        size_t size = 0;
+        stream_frame_t *frame = xRingbufferReceive(s_ring, &size,
+                                                   pdMS_TO_TICKS(STREAM_BATCH_TIMEOUT_MS));
+        if (frame != NULL) {
+#if CONFIG_APP_LOCAL_HTTP
+            // El histórico local guarda cada muestra, sin agregar
+            local_http_push(frame);
+#endif
+#if CONFIG_APP_STATS_WINDOW > 1
+            // Cada ventana de tramas se reduce a un único registro agregado
+            bool full = stats_window_add(&window, frame->channels,
+                                         frame->voltage, frame->ec_value);
+            int64_t ts_ms = frame->ts_ms;
+            vRingbufferReturnItem(s_ring, frame);
+            if (full) {
+                stats_window_finalize(&window, result);
+                if (online) {
+                    telemetry_build_stats_json(values, sizeof(values), result,
+                                               window.count, ec_sensor_is_calibrated());
+                    if (batch_append(payload, sizeof(payload), &len, count, ts_ms, values)) {
+                        count++;
+                    }
+                } else {
+                    size_t rec_len = telemetry_record_stats(&record, result, window.count,
+                                                            ec_sensor_is_calibrated());
+                    journal_offline(&journal_last_us, ts_ms, &record, rec_len);
+                }
+                stats_window_reset(&window);
+            }
+#else
+            if (online) {
+                telemetry_build_json(values, sizeof(values), frame->channels,
+                                     frame->voltage, frame->ec_value, ec_sensor_is_calibrated());
+                if (batch_append(payload, sizeof(payload), &len, count, frame->ts_ms, values)) {
+                    count++;
+                }
+            } else {
+                size_t rec_len = telemetry_record_sample(&record, frame->channels, frame->voltage,
+                                                         frame->ec_value, ec_sensor_is_calibrated());
+                journal_offline(&journal_last_us, frame->ts_ms, &record, rec_len);
+            }
+            vRingbufferReturnItem(s_ring, frame);
+#endif
+        }
+
+        // Lote completo, o parcial si el productor se ha parado o se ha
+        // perdido la conexión (QoS 1: esp-mqtt lo reintenta al reconectar)
+        if (count > 0 && (count >= CONFIG_APP_STREAM_BATCH || frame == NULL || !online)) {
+            if (len < (int)sizeof(payload) - 1) {
+                payload[len++] = ']';
+                payload[len] = '\0';
+                s_net.publish(payload);
+            } else {
+                ESP_LOGE(TAG, "Error: Buffer de lote demasiado pequeño");
+            }
+            count = 0;
+            len = 0;
+        }
+
+        // Con conexión, reenvío de lo guardado durante el corte
+        if (online && journal_pending_count() > 0 &&
+            journal_replay(s_net.publish_record, STREAM_REPLAY_BATCH) > 0) {
+            journal_wait_acked(STREAM_REPLAY_ACK_MS);
+        }
+
+        int64_t elapsed_us = esp_timer_get_time() - stats_t0;
+        if (elapsed_us >= STREAM_STATS_PERIOD_MS * 1000LL) {
+            uint32_t produced = s_produced;
+            float sps = (float)(produced - stats_produced0) * 1e6f / (float)elapsed_us;
+            char stats[80];
+            snprintf(stats, sizeof(stats), "{\"stream_sps\":%.2f,\"stream_dropped\":%lu}",
+                     sps, (unsigned long)s_dropped);
+            ESP_LOGI(TAG, "%.2f muestras/s, %lu tramas perdidas", sps, (unsigned long)s_dropped);
+            if (online) {
+                s_net.publish(stats);
+            }
+
+            stats_t0 = esp_timer_get_time();
+            stats_produced0 = produced;
+        }
+    }
+}
+
+void stream_start(const stream_net_t *net)
+{
+    if (s_ring != NULL) {
+        return;
+    }
+
+    s_net = *net;
+    s_ring = xRingbufferCreateNoSplit(sizeof(stream_frame_t), CONFIG_APP_STREAM_RING_SIZE);
+    if (s_ring == NULL) {
+        ESP_LOGE(TAG, "No hay memoria para el ring buffer");
+        return;
+    }
+
+    xTaskCreatePinnedToCore(stream_producer_task, "stream_acq", 4096, NULL, 6, NULL, APP_CPU_NUM);
+    xTaskCreatePinnedToCore(stream_consumer_task, "stream_pub", 4096, NULL, 5, NULL, PRO_CPU_NUM);
+}
@@ -0,0 +1,47 @@
+/*
+ * stream.h
+ * Modo continuo (alimentación de red): adquisición en un núcleo, red en el
+ * otro, unidos por un ring buffer de FreeRTOS.
+ */
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "as7265x.h"
+#include "journal.h"
+
+// Una muestra del pipeline productor/consumidor
+typedef struct {
+    uint32_t seq;                                // número de muestra
+    int64_t  ts_ms;                              // epoch en ms (SNTP)
+    uint16_t channels[AS7265X_TOTAL_CHANNELS];
+    float    voltage;
+    float    ec_value;
+} stream_frame_t;
+
+// Función de publicación (p. ej. send_mqtt_data de main.c)
+typedef void (*stream_publish_fn_t)(const char *payload);
+
+// Enlace con la red (funciones de main.c)
+typedef struct {
+    stream_publish_fn_t publish;        // lotes en directo
+    journal_send_fn_t   publish_record; // reenvío de registros del diario
+    bool (*online)(void);               // true si el broker está conectado
+} stream_net_t;
+
+/**
+ * @brief Arranca el modo continuo (idempotente).
+ *
+ * La tarea de adquisición se fija en APP_CPU y la de publicación en
+ * PRO_CPU junto a la pila Wi-Fi. Con conexión, las muestras se publican
+ * en lotes y cada STREAM_STATS_PERIOD_MS se publican muestras/s y tramas
+ * perdidas. Sin conexión, se guarda en el diario de flash un registro
+ * cada APP_STREAM_JOURNAL_PERIOD_S, que se reenvía al reconectar.
+ *
+ * @param net Funciones de red; se copian.
+ */
+void stream_start(const stream_net_t *net);
+
+#endif // STREAM_H
@@ -0,0 +1,155 @@
+/*
+ * telemetry.c
+ * Construcción del JSON de telemetría para ThingsBoard.
+ */
+
+#include "telemetry.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+// Clave del dashboard para cada variable (índice de canal del driver)
+static const char *const s_keys[STATS_NUM_VARS] = {
+    "R", "S", "T", "U", "V", "W",       // canales 0-5
+    "G", "H", "I", "J", "K", "L",       // canales 6-11
+    "A", "B", "C", "D", "E", "F",       // canales 12-17
+    "Voltage", "EC_Value",
+};
+
+// Orden de publicación (el mismo que el payload de una sola muestra)
+static const uint8_t s_order[STATS_NUM_VARS] = {
+    12, 13, 14, 15, 16, 17, 6, 7, 8, 9, 10, 11, 0, 1, 2, 3, 4, 5,
+    STATS_VAR_VOLTAGE, STATS_VAR_EC,
+};
+
+// ---------- FUNCIONES PRIVADAS (Auxiliares) ----------
+
+static int build_json(char *buf, size_t size, uint32_t mask, const uint16_t *channels,
+                      float voltage, float ec_value, bool calibrated)
+{
+    size_t len = 0;
+
+    // Solo los canales seleccionados en la máscara
+    for (int i = 0; i < AS7265X_TOTAL_CHANNELS; i++) {
+        uint8_t ch = s_order[i];
+        if (!(mask & (1u << ch))) {
+            continue;
+        }
+        int w = snprintf(buf + len, size - len, "%s\"%s\":%.2f",
+                         len == 0 ? "{" : ",", s_keys[ch], (float)channels[ch]);
+        if (w < 0) {
+            return w;
+        }
+        len += w;
+        if (len >= size) {
+            return len;
+        }
+    }
+
+    len += snprintf(buf + len, size - len,
+                    "%s\"Voltage\":%.2f,\"EC_Value\":%.2f,\"EC_Calibrated\":%s}",
+                    len == 0 ? "{" : ",", voltage, ec_value, calibrated ? "true" : "false");
+    return len;
+}
+
+static int build_stats_json(char *buf, size_t size, uint32_t mask, const stats_var_t *vars,
+                            uint16_t n, bool calibrated)
+{
+    size_t len = 0;
+    unsigned rejected = 0;
+
+    for (int i = 0; i < STATS_NUM_VARS; i++) {
+        uint8_t var = s_order[i];
+        // Canales fuera de la máscara no se publican (voltaje y EC siempre)
+        if (var < AS7265X_TOTAL_CHANNELS && !(mask & (1u << var))) {
+            continue;
+        }
+        const stats_var_t *v = &vars[var];
+        const char *key = s_keys[var];
+        int w = snprintf(buf + len, size - len,
+                         "%s\"%s\":%.2f,\"%s_sd\":%.2f,\"%s_min\":%.2f,\"%s_max\":%.2f",
+                         len == 0 ? "{" : ",", key, v->mean, key, v->stddev,
+                         key, v->min, key, v->max);
+        if (w < 0) {
+            return w;
+        }
+        len += w;
+        if (len >= size) {
+            return len;
+        }
+        rejected += v->rejected;
+    }
+
+    len += snprintf(buf + len, size - len, ",\"n\":%u,\"rejected\":%u,\"EC_Calibrated\":%s}",
+                    n, rejected, calibrated ? "true" : "false");
+    return len;
+}
+
+// ---------- FUNCIONES PÚBLICAS ----------
+
+int telemetry_build_json(char *buf, size_t size, const uint16_t *channels,
+                         float voltage, float ec_value, bool calibrated)
+{
+    return build_json(buf, size, as7265x_get_channel_mask(), channels,
+                      voltage, ec_value, calibrated);
+}
+
+int telemetry_build_stats_json(char *buf, size_t size, const stats_var_t *vars,
+                               uint16_t n, bool calibrated)
+{
+    return build_stats_json(buf, size, as7265x_get_channel_mask(), vars, n, calibrated);
+}
+
+size_t telemetry_record_sample(telemetry_record_t *rec, const uint16_t *channels,
+                               float voltage, float ec_value, bool calibrated)
+{
+    rec->kind = TELEMETRY_REC_SAMPLE;
+    rec->calibrated = calibrated;
+    rec->n = 1;
+    rec->mask = as7265x_get_channel_mask();
+    memcpy(rec->sample.channels, channels, sizeof(rec->sample.channels));
+    rec->sample.voltage = voltage;
+    rec->sample.ec_value = ec_value;
+    return offsetof(telemetry_record_t, sample) + sizeof(rec->sample);
+}
+
+size_t telemetry_record_stats(telemetry_record_t *rec, const stats_var_t *vars,
+                              uint16_t n, bool calibrated)
+{
+    rec->kind = TELEMETRY_REC_STATS;
+    rec->calibrated = calibrated;
+    rec->n = n;
+    rec->mask = as7265x_get_channel_mask();
+    for (int v = 0; v < STATS_NUM_VARS; v++) {
+        rec->stats.mean[v] = vars[v].mean;
+        rec->stats.stddev[v] = vars[v].stddev;
+        rec->stats.min[v] = vars[v].min;
+        rec->stats.max[v] = vars[v].max;
+        rec->stats.rejected[v] = vars[v].rejected > UINT8_MAX ? UINT8_MAX : vars[v].rejected;
+    }
+    return offsetof(telemetry_record_t, stats) + sizeof(rec->stats);
+}
+
+int telemetry_record_to_json(char *buf, size_t size, const telemetry_record_t *rec, size_t len)
+{
+    if (rec->kind == TELEMETRY_REC_SAMPLE &&
+        len >= offsetof(telemetry_record_t, sample) + sizeof(rec->sample)) {
+        return build_json(buf, size, rec->mask, rec->sample.channels,
+                          rec->sample.voltage, rec->sample.ec_value, rec->calibrated);
+    }
+
+    if (rec->kind == TELEMETRY_REC_STATS &&
+        len >= offsetof(telemetry_record_t, stats) + sizeof(rec->stats)) {
+        stats_var_t vars[STATS_NUM_VARS];
+        for (int v = 0; v < STATS_NUM_VARS; v++) {
+            vars[v].mean = rec->stats.mean[v];
+            vars[v].stddev = rec->stats.stddev[v];
+            vars[v].min = rec->stats.min[v];
+            vars[v].max = rec->stats.max[v];
+            vars[v].rejected = rec->stats.rejected[v];
+        }
+        return build_stats_json(buf, size, rec->mask, vars, rec->n, rec->calibrated);
+    }
+    return -1;
+}
@@ -0,0 +1,115 @@
+/*
+ * telemetry.h
+ * Construcción del JSON de telemetría para ThingsBoard.
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "stats.h"
+
+// Tamaño máximo del JSON agregado de una ventana
+#define TELEMETRY_STATS_MAX_LEN  1800
+// Tamaño máximo del JSON de una muestra (18 canales de 5 cifras, voltaje y EC)
+#define TELEMETRY_SAMPLE_MAX_LEN 384
+
+// Marcas de tiempo anteriores a 2016 indican hora sin sincronizar: sin "ts"
+// ThingsBoard usa la hora de llegada
+#define TS_VALID_MIN_MS          1451606400000LL
+
+// Tipo de registro binario
+#define TELEMETRY_REC_SAMPLE     1
+#define TELEMETRY_REC_STATS      2
+
+/*
+ * Registro binario compacto de una muestra o de una ventana agregada. Es lo
+ * que se guarda en el diario de flash; el JSON se construye al publicarlo.
+ * Solo se usan los bytes que devuelve telemetry_record_sample()/_stats().
+ */
+typedef struct {
+    uint8_t  kind;                      // TELEMETRY_REC_SAMPLE / TELEMETRY_REC_STATS
+    uint8_t  calibrated;
+    uint16_t n;                         // adquisiciones de la ventana (1 en SAMPLE)
+    uint32_t mask;                      // máscara de canales al adquirir
+    union {
+        struct {
+            uint16_t channels[AS7265X_TOTAL_CHANNELS];
+            float    voltage;
+            float    ec_value;
+        } sample;
+        struct {
+            float    mean[STATS_NUM_VARS];
+            float    stddev[STATS_NUM_VARS];
+            float    min[STATS_NUM_VARS];
+            float    max[STATS_NUM_VARS];
+            uint8_t  rejected[STATS_NUM_VARS];
+        } stats;
+    };
+} telemetry_record_t;
+
+/**
+ * @brief Escribe el objeto JSON con los 18 canales, voltaje y EC.
+ *
+ * Los canales se publican con las claves del dashboard: A-F (índices 12-17),
+ * G-L (6-11) y R-W (0-5). Solo se incluyen los canales de la máscara
+ * activa (as7265x_get_channel_mask()).
+ *
+ * @param buf Buffer de salida.
+ * @param size Tamaño del buffer.
+ * @param channels Array de AS7265X_TOTAL_CHANNELS valores.
+ * @param voltage Voltaje medido en la sonda EC.
+ * @param ec_value EC en mS/cm (-1 si no hay calibración).
+ * @param calibrated true si la EC está calibrada.
+ * @return int Longitud escrita (como snprintf); >= size indica truncado.
+ */
+int telemetry_build_json(char *buf, size_t size, const uint16_t *channels,
+                         float voltage, float ec_value, bool calibrated);
+
+/**
+ * @brief Escribe el objeto JSON agregado de una ventana de adquisiciones.
+ *
+ * Para cada variable publica la media con la clave habitual del dashboard
+ * y, además, <clave>_sd, <clave>_min y <clave>_max. Los canales fuera de
+ * la máscara activa se omiten. Añade "n" (muestras de
+ * la ventana) y "rejected" (outliers descartados en total).
+ *
+ * @param buf Buffer de salida (TELEMETRY_STATS_MAX_LEN recomendado).
+ * @param size Tamaño del buffer.
+ * @param vars Array de STATS_NUM_VARS resultados de stats_window_finalize().
+ * @param n Número de adquisiciones de la ventana.
+ * @param calibrated true si la EC está calibrada.
+ * @return int Longitud escrita; >= size indica truncado, < 0 error.
+ */
+int telemetry_build_stats_json(char *buf, size_t size, const stats_var_t *vars,
+                               uint16_t n, bool calibrated);
+
+/**
+ * @brief Rellena un registro binario con una muestra.
+ *
+ * @return size_t Bytes útiles del registro (lo que hay que guardar).
+ */
+size_t telemetry_record_sample(telemetry_record_t *rec, const uint16_t *channels,
+                               float voltage, float ec_value, bool calibrated);
+
+/**
+ * @brief Rellena un registro binario con el agregado de una ventana.
+ *
+ * @return size_t Bytes útiles del registro (lo que hay que guardar).
+ */
+size_t telemetry_record_stats(telemetry_record_t *rec, const stats_var_t *vars,
+                              uint16_t n, bool calibrated);
+
+/**
+ * @brief Escribe el JSON de un registro binario (mismo formato que
+ *        telemetry_build_json()/telemetry_build_stats_json(), con la máscara
+ *        y la calibración del momento de la adquisición).
+ *
+ * @param len Bytes del registro, para validar que está completo.
+ * @return int Longitud escrita; >= size indica truncado, < 0 registro inválido.
+ */
+int telemetry_record_to_json(char *buf, size_t size, const telemetry_record_t *rec, size_t len);
+
+#endif // TELEMETRY_H
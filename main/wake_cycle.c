@@ -0,0 +1,52 @@
+/*
+ * wake_cycle.c
+ * Reparto de los despertares de deep-sleep entre adquisición y subida.
+ *
+ * Cada despertar adquiere; solo uno de cada CONFIG_APP_UPLOAD_EVERY enciende
+ * el Wi-Fi. El resto del ahorro lo da dormir el intervalo completo de una vez.
+ */
+
+#include "wake_cycle.h"
+
+#include "esp_attr.h"
+#include "esp_system.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "WAKE_CYCLE";
+
+#define WAKE_CYCLE_MAGIC  0x57414B45u   // "WAKE"
+
+// Contadores persistentes entre ciclos de deep-sleep
+typedef struct {
+    uint32_t magic;
+    uint32_t cycle;             // despertares desde el arranque en frío
+    uint32_t acq_since_upload;  // adquisiciones sin subir datos
+} wake_cycle_t;
+
+static RTC_DATA_ATTR wake_cycle_t s_cycle;
+
+// ---------- FUNCIONES PÚBLICAS ----------
+
+bool wake_cycle_upload_due(bool force)
+{
+    if (esp_reset_reason() != ESP_RST_DEEPSLEEP || s_cycle.magic != WAKE_CYCLE_MAGIC) {
+        // Arranque en frío: la RTC no tiene contadores válidos
+        s_cycle.magic = WAKE_CYCLE_MAGIC;
+        s_cycle.cycle = 0;
+        s_cycle.acq_since_upload = 0;
+        return true;
+    }
+
+    s_cycle.cycle++;
+    s_cycle.acq_since_upload++;
+    ESP_LOGI(TAG, "Despertar %lu, adquisición %lu/%d desde la última subida",
+             (unsigned long)s_cycle.cycle, (unsigned long)s_cycle.acq_since_upload,
+             CONFIG_APP_UPLOAD_EVERY);
+
+    if (force || s_cycle.acq_since_upload >= CONFIG_APP_UPLOAD_EVERY) {
+        s_cycle.acq_since_upload = 0;
+        return true;
+    }
+    return false;
+}
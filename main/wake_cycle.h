@@ -0,0 +1,21 @@
+/*
+ * wake_cycle.h
+ * Reparto de los despertares de deep-sleep entre adquisición y subida.
+ */
+
+#ifndef WAKE_CYCLE_H
+#define WAKE_CYCLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Decide si en este arranque toca subir datos (Wi-Fi + MQTT).
+ *
+ * Se sube cada CONFIG_APP_UPLOAD_EVERY adquisiciones, en el primer arranque
+ * en frío y siempre que force sea true. Entre medias las muestras quedan en
+ * el diario y no se inicializa el Wi-Fi. El contador vive en memoria RTC.
+ */
+bool wake_cycle_upload_due(bool force);
+
+#endif // WAKE_CYCLE_H
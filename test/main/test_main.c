@@ -0,0 +1,35 @@
+/*
+ * test_main.c
+ * Arranque de la app de pruebas: inicializa NVS y los drivers y ejecuta
+ * los casos Unity. El resumen final ("N Tests M Failures ...") es lo que
+ * comprueba pytest_perf.py.
+ */
+
+#include "unity.h"
+#include "nvs_flash.h"
+#include "sdkconfig.h"
+
+#include "i2c.h"
+#include "ec_sensor.h"
+
+void app_main(void)
+{
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        ret = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK(ret);
+
+    i2cm_init();
+    ec_sensor_init();
+
+    UNITY_BEGIN();
+#if CONFIG_APP_TEST_QEMU
+    // Sin ADC emulado: las pruebas [hw] solo en placa
+    unity_run_tests_by_tag("[hw]", true);
+#else
+    unity_run_all_tests();
+#endif
+    UNITY_END();
+}
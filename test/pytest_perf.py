@@ -0,0 +1,49 @@
+# Ejecuta la app de pruebas en QEMU y falla si algún caso Unity falla
+# (p. ej. una medida por encima de su referencia) o se ignora (referencia
+# sin medir). Con PERF_UPDATE_BASELINES=1 escribe las medias medidas como
+# referencias en sdkconfig.defaults.
+import os
+import re
+
+import pytest
+from pytest_embedded_idf.dut import IdfDut
+
+# Nombre de la medida -> opción de su referencia
+BASELINES = {
+    'as7265x_read': 'CONFIG_APP_PERF_BASELINE_AS7265X',
+    'ec_read': 'CONFIG_APP_PERF_BASELINE_EC',
+    'payload_json': 'CONFIG_APP_PERF_BASELINE_PAYLOAD',
+    'stats_window': 'CONFIG_APP_PERF_BASELINE_STATS',
+    'nvs_calib': 'CONFIG_APP_PERF_BASELINE_NVS',
+}
+DEFAULTS = os.path.join(os.path.dirname(__file__), 'sdkconfig.defaults')
+
+
+def update_baselines(measured: dict) -> None:
+    with open(DEFAULTS) as f:
+        text = f.read()
+    for name, avg in measured.items():
+        text = re.sub(r'^{}=\d+$'.format(BASELINES[name]),
+                      '{}={}'.format(BASELINES[name], avg), text, flags=re.M)
+    with open(DEFAULTS, 'w') as f:
+        f.write(text)
+
+
+@pytest.mark.esp32
+@pytest.mark.qemu
+def test_perf_qemu(dut: IdfDut) -> None:
+    measured = {}
+    while True:
+        match = dut.expect(re.compile(rb'PERF (\S+)\s+avg=(\d+) kcyc|'
+                                      rb'(\d+) Tests (\d+) Failures (\d+) Ignored'), timeout=300)
+        if match.group(1) is None:
+            break
+        measured[match.group(1).decode()] = int(match.group(2))
+
+    if os.environ.get('PERF_UPDATE_BASELINES') == '1':
+        update_baselines(measured)
+        return
+
+    assert int(match.group(4)) == 0, 'Hay pruebas fallidas: ver las líneas PERF y FAIL'
+    assert int(match.group(5)) == 0, \
+        'Referencias sin medir: ejecutar con PERF_UPDATE_BASELINES=1 y subir sdkconfig.defaults'